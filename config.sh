@@ -18,6 +18,7 @@ export CFLAGS='-O2 -g'
 export CPPFLAGS=''
 export ATA_DMA=${ATA_DMA:-0}
 export ATA_DMA_VERIFY=${ATA_DMA_VERIFY:-1}
+export KPTI=${KPTI:-1}
 
 # Configure the cross-compiler to use the desired system root.
 export SYSROOT="$(pwd)/sysroot"
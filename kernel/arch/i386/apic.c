@@ -0,0 +1,102 @@
+#include <kernel/apic.h>
+#include <kernel/cpu.h>
+#include <kernel/memory.h>
+#include <kernel/pagings.h>
+#include <stdio.h>
+
+// Local APIC registers (offsets from the MMIO base)
+#define LAPIC_REG_ID          0x020
+#define LAPIC_REG_TPR         0x080
+#define LAPIC_REG_EOI         0x0B0
+#define LAPIC_REG_SVR         0x0F0
+#define LAPIC_REG_LVT_TIMER   0x320
+#define LAPIC_REG_LVT_LINT0   0x350
+#define LAPIC_REG_LVT_LINT1   0x360
+#define LAPIC_REG_LVT_ERROR   0x370
+#define LAPIC_REG_TIMER_INIT  0x380
+#define LAPIC_REG_TIMER_CUR   0x390
+#define LAPIC_REG_TIMER_DIV   0x3E0
+
+#define LAPIC_SVR_ENABLE      0x100
+#define LAPIC_LVT_MASKED      0x10000
+#define LAPIC_LVT_EXTINT      0x700
+#define LAPIC_LVT_NMI         0x400
+#define LAPIC_TIMER_DIV_16    0x3
+
+#define APIC_BASE_ENABLE      0x800
+#define APIC_BASE_ADDR_MASK   0xFFFFF000
+
+static volatile uint32_t *lapic_regs = NULL;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+	return lapic_regs[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+	lapic_regs[reg / 4] = value;
+	(void)lapic_regs[LAPIC_REG_ID / 4];
+}
+
+bool lapic_init(void) {
+	if (lapic_regs) {
+		return true;
+	}
+	if (!cpu_has_feature(CPUID_FEAT_EDX_APIC) || !cpu_has_feature(CPUID_FEAT_EDX_MSR)) {
+		return false;
+	}
+
+	uint32_t base = (uint32_t)rdmsr(MSR_APIC_BASE);
+	uint32_t phys = base & APIC_BASE_ADDR_MASK;
+	if (!page_map(page_kernel_directory(), KERNEL_MMIO_BASE, phys,
+	              PAGE_RW | PAGE_PCD | PAGE_PWT)) {
+		return false;
+	}
+	invlpg(KERNEL_MMIO_BASE);
+	wrmsr(MSR_APIC_BASE, (uint64_t)(base | APIC_BASE_ENABLE));
+	lapic_regs = (volatile uint32_t *)KERNEL_MMIO_BASE;
+
+	// Virtual wire: the PIC stays wired to LINT0, NMIs come in on LINT1.
+	lapic_write(LAPIC_REG_LVT_LINT0, LAPIC_LVT_EXTINT);
+	lapic_write(LAPIC_REG_LVT_LINT1, LAPIC_LVT_NMI);
+	lapic_write(LAPIC_REG_LVT_ERROR, LAPIC_LVT_MASKED | LAPIC_SPURIOUS_VECTOR);
+	lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_REG_TIMER_DIV, LAPIC_TIMER_DIV_16);
+	lapic_write(LAPIC_REG_TPR, 0);
+	lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+	return true;
+}
+
+bool lapic_available(void) {
+	return lapic_regs != NULL;
+}
+
+void lapic_eoi(void) {
+	if (lapic_regs) {
+		lapic_write(LAPIC_REG_EOI, 0);
+	}
+}
+
+void lapic_timer_start_masked(uint32_t count) {
+	if (!lapic_regs) {
+		return;
+	}
+	lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+	lapic_write(LAPIC_REG_TIMER_INIT, count);
+}
+
+void lapic_timer_oneshot(uint8_t vector, uint32_t count) {
+	if (!lapic_regs) {
+		return;
+	}
+	if (count == 0) {
+		lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+		lapic_write(LAPIC_REG_TIMER_INIT, 0);
+		return;
+	}
+	lapic_write(LAPIC_REG_LVT_TIMER, vector);
+	lapic_write(LAPIC_REG_TIMER_INIT, count);
+}
+
+uint32_t lapic_timer_current(void) {
+	return lapic_regs ? lapic_read(LAPIC_REG_TIMER_CUR) : 0;
+}
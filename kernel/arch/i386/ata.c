@@ -1,6 +1,7 @@
 #include <kernel/ata.h>
 #include <kernel/io.h>
 #include <kernel/memory.h>
+#include <kernel/pagings.h>
 #include <kernel/pci.h>
 #include <kernel/tty.h>
 #include <string.h>
@@ -9,7 +10,10 @@
 static ata_device_t ata_devices[4]; // Primary master/slave, Secondary master/slave
 
 // DMA buffers and PRDT (must be physically contiguous and aligned)
-static uint8_t dma_buffer[65536] __attribute__((aligned(65536)));
+// The DMA bounce buffer comes from the frame allocator as one 64 KiB-aligned
+// run so a transfer never crosses a 64 KiB boundary.
+#define ATA_DMA_BUFFER_SIZE 65536
+static uint8_t *dma_buffer = NULL;
 static prdt_entry_t prdt[16] __attribute__((aligned(4)));
 
 // Bus Master IDE base addresses (will be detected or use defaults)
@@ -231,6 +235,15 @@ void ata_init(void) {
     
     memset(ata_devices, 0, sizeof(ata_devices));
 
+    if (!dma_buffer) {
+        uint32_t dma_phys = frame_alloc_contiguous(ATA_DMA_BUFFER_SIZE / PAGE_SIZE);
+        if (dma_phys) {
+            dma_buffer = (uint8_t *)phys_to_virt(dma_phys);
+        } else {
+            printf("ATA: No memory for DMA buffer, using PIO only\n");
+        }
+    }
+
     bool bmide_found = false;
     pci_device_t ide_dev;
     if (pci_find_class(0x01, 0x01, 0xFF, &ide_dev)) {
@@ -402,7 +415,7 @@ bool ata_write_sectors(uint8_t drive, uint32_t lba, uint8_t sector_count, const
         uint32_t byte_count = sector_count * ATA_SECTOR_SIZE;
         
         // Copy to aligned DMA buffer
-        if (byte_count <= sizeof(dma_buffer)) {
+        if (dma_buffer && byte_count <= ATA_DMA_BUFFER_SIZE) {
             memcpy(dma_buffer, buffer, byte_count);
             
             // Wait for drive ready
@@ -1,8 +1,10 @@
 #include <kernel/cpu.h>
+#include <kernel/fpu.h>
 #include <kernel/process.h>
 #include <kernel/syscall.h>
 #include <kernel/trap_frame.h>
 #include <kernel/pagings.h>
+#include <kernel/usercopy.h>
 #include <kernel/graphics.h>
 #include <kernel/panic.h>
 #include <stdio.h>
@@ -75,6 +77,22 @@ static void isr_from_trap(isr_frame_t *out, const trap_frame_t *in) {
 	out->userss = in->userss;
 }
 
+extern char trampoline_sysenter_stub[];
+extern char trampoline_spurious_stub[];
+extern char sysenter_stub[];
+extern char syscall_stub[];
+
+// SYSENTER does not clear TF, so a user single-stepping over it takes a
+// debug trap on the first kernel instructions of the entry path.
+static bool sysenter_single_step(const isr_frame_t *frame) {
+	if (frame->int_no != 1 || !(frame->eflags & EFLAGS_TF)) {
+		return false;
+	}
+	uint32_t eip = frame->eip;
+	return (eip >= (uint32_t)trampoline_sysenter_stub && eip < (uint32_t)trampoline_spurious_stub) ||
+	       (eip >= (uint32_t)sysenter_stub && eip < (uint32_t)syscall_stub);
+}
+
 static void recover_user_graphics_mode(void) {
 	if (graphics_get_mode() == MODE_TEXT) {
 		return;
@@ -91,6 +109,11 @@ void isr_handler(isr_frame_t *frame) {
     }
 
     bool user = (frame->cs & 0x3) == 0x3;
+    // Device not available: first FPU instruction since the last switch.
+    if (frame->int_no == 7 && fpu_handle_trap(user)) {
+        return;
+    }
+
     uint32_t fault_addr = 0;
     if (frame->int_no == 14) {
         fault_addr = read_cr2();
@@ -104,6 +127,27 @@ void isr_handler(isr_frame_t *frame) {
         }
     }
 
+    // Finish the entry with TF off; sysenter_stub hands it back to the user.
+    if (!user && sysenter_single_step(frame)) {
+        frame->eflags &= ~EFLAGS_TF;
+        syscall_sysenter_tf = 1;
+        return;
+    }
+
+    // Kernel faults on user addresses are only legal inside the user access
+    // routines: resolve copy-on-write, otherwise resume at the fixup.
+    uint32_t fixup_eip = 0;
+    if (!user && frame->int_no == 14 && fault_addr < USER_SPACE_END &&
+        usercopy_fixup(frame->eip, &fixup_eip)) {
+        process_t *proc = process_current();
+        if ((frame->err_code & 0x3) == 0x3 && proc && proc->page_directory &&
+            page_handle_cow(proc->page_directory, fault_addr)) {
+            return;
+        }
+        frame->eip = fixup_eip;
+        return;
+    }
+
     if (user) {
         recover_user_graphics_mode();
         log_user_fault(frame, fault_addr);
@@ -0,0 +1,163 @@
+#include <kernel/fpu.h>
+#include <kernel/cpu.h>
+#include <kernel/process.h>
+#include <kernel/slab.h>
+#include <stdio.h>
+#include <string.h>
+
+static bool fpu_present = false;
+static bool fpu_fxsr = false;
+static kmem_cache_t *fpu_cache = NULL;
+// Process whose state is live in the registers (NULL: none or the kernel)
+static struct process *fpu_owner = NULL;
+// Registers right after FNINIT (and default MXCSR), copied into new areas.
+static fpu_state_t fpu_initial_state;
+
+static inline void fpu_clts(void) {
+	__asm__ volatile ("clts");
+}
+
+static inline void fpu_set_ts(void) {
+	write_cr0(read_cr0() | CR0_TS);
+}
+
+static void fpu_save(fpu_state_t *state) {
+	if (fpu_fxsr) {
+		__asm__ volatile ("fxsave %0" : "=m"(*state));
+	} else {
+		__asm__ volatile ("fnsave %0; fwait" : "=m"(*state));
+	}
+}
+
+static void fpu_restore(const fpu_state_t *state) {
+	if (fpu_fxsr) {
+		__asm__ volatile ("fxrstor %0" : : "m"(*state));
+	} else {
+		__asm__ volatile ("frstor %0" : : "m"(*state));
+	}
+}
+
+void fpu_init(void) {
+	uint32_t eax, ebx, ecx, edx;
+	cpuid(1, &eax, &ebx, &ecx, &edx);
+	if (!(edx & CPUID_FEAT_EDX_FPU)) {
+		printf("FPU: not present\n");
+		return;
+	}
+	// MP: WAIT honours TS too. NE: report FPU errors as #MF, not IRQ13.
+	uint32_t cr0 = read_cr0();
+	cr0 &= ~(CR0_EM | CR0_TS);
+	cr0 |= CR0_MP | CR0_NE;
+	write_cr0(cr0);
+
+	fpu_fxsr = (edx & CPUID_FEAT_EDX_FXSR) != 0;
+	bool sse = fpu_fxsr && (edx & CPUID_FEAT_EDX_SSE);
+	if (fpu_fxsr) {
+		uint32_t cr4 = read_cr4() | CR4_OSFXSR;
+		if (sse) {
+			cr4 |= CR4_OSXMMEXCPT;
+		}
+		write_cr4(cr4);
+	}
+
+	__asm__ volatile ("fninit");
+	if (sse) {
+		uint32_t mxcsr = 0x1F80;    // All SIMD exceptions masked
+		__asm__ volatile ("ldmxcsr %0" : : "m"(mxcsr));
+	}
+	fpu_save(&fpu_initial_state);
+
+	fpu_cache = kmem_cache_create("fpu", sizeof(fpu_state_t), 16, NULL);
+	fpu_present = true;
+	fpu_set_ts();
+	printf("FPU: lazy switching with %s\n", fpu_fxsr ? "FXSAVE" : "FNSAVE");
+}
+
+static fpu_state_t *fpu_state_alloc(void) {
+	fpu_state_t *state = fpu_cache ? (fpu_state_t *)kmem_cache_alloc(fpu_cache) : NULL;
+	if (state) {
+		memcpy(state, &fpu_initial_state, sizeof(*state));
+	}
+	return state;
+}
+
+bool fpu_handle_trap(bool user) {
+	if (!fpu_present) {
+		return false;
+	}
+	fpu_clts();
+	// A trap from kernel mode inside a system call runs on behalf of the
+	// current process, so it gets that process's registers as well.
+	process_t *proc = process_current();
+	if (fpu_owner == proc) {
+		return true;
+	}
+	if (proc && !proc->fpu) {
+		proc->fpu = fpu_state_alloc();
+		if (!proc->fpu) {
+			if (user) {
+				fpu_set_ts();
+				return false;
+			}
+			proc = NULL;
+		}
+	}
+	if (fpu_owner) {
+		fpu_save(fpu_owner->fpu);
+	}
+	if (proc) {
+		fpu_restore(proc->fpu);
+	}
+	fpu_owner = proc;
+	return true;
+}
+
+void fpu_switch(struct process *proc) {
+	if (!fpu_present) {
+		return;
+	}
+	// Going back to the owner needs no trap: its registers are still loaded.
+	if (proc && proc == fpu_owner) {
+		fpu_clts();
+	} else {
+		fpu_set_ts();
+	}
+}
+
+bool fpu_fork(struct process *parent, struct process *child) {
+	if (!parent || !child || !parent->fpu) {
+		return true;
+	}
+	child->fpu = fpu_state_alloc();
+	if (!child->fpu) {
+		return false;
+	}
+	if (fpu_owner == parent) {
+		// FNSAVE reinitialises the FPU, so reload what was just saved.
+		uint32_t cr0 = read_cr0();
+		fpu_clts();
+		fpu_save(parent->fpu);
+		if (!fpu_fxsr) {
+			fpu_restore(parent->fpu);
+		}
+		write_cr0(cr0);
+	}
+	memcpy(child->fpu, parent->fpu, sizeof(fpu_state_t));
+	return true;
+}
+
+void fpu_release(struct process *proc) {
+	if (!proc) {
+		return;
+	}
+	if (fpu_owner == proc) {
+		fpu_owner = NULL;
+		if (fpu_present) {
+			fpu_set_ts();
+		}
+	}
+	if (proc->fpu) {
+		kmem_cache_free(fpu_cache, proc->fpu);
+		proc->fpu = NULL;
+	}
+}
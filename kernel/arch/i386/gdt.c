@@ -1,4 +1,5 @@
 #include <kernel/gdt.h>
+#include <kernel/cpu.h>
 #include <string.h>
 
 typedef struct {
@@ -39,8 +40,10 @@ static gdt_ptr_t gdt_ptr;
 static tss_entry_t tss_entry;
 
 static uint8_t tss_stack[4096] __attribute__((aligned(16)));
+static bool sysenter_on = false;
 
 extern void gdt_flush(uint32_t);
+extern void trampoline_sysenter_stub(void);
 
 static void gdt_set_gate(int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
 	gdt_entries[num].base_low = (base & 0xFFFF);
@@ -85,6 +88,35 @@ void gdt_init(void) {
 
 void tss_set_kernel_stack(uint32_t stack_top) {
 	tss_entry.esp0 = stack_top;
+	if (sysenter_on) {
+		wrmsr(MSR_SYSENTER_ESP, stack_top);
+	}
+}
+
+void sysenter_init(void) {
+	if (!cpu_has_feature(CPUID_FEAT_EDX_SEP)) {
+		return;
+	}
+	// Early Pentium Pro parts report SEP without implementing it.
+	uint32_t eax, ebx, ecx, edx;
+	cpuid(1, &eax, &ebx, &ecx, &edx);
+	uint32_t family = (eax >> 8) & 0xF;
+	uint32_t model = (eax >> 4) & 0xF;
+	uint32_t stepping = eax & 0xF;
+	if (family == 6 && model < 3 && stepping < 3) {
+		return;
+	}
+
+	// SYSEXIT derives the user selectors from SYSENTER_CS (+16 and +24),
+	// which matches the GDT layout above.
+	wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE);
+	wrmsr(MSR_SYSENTER_ESP, tss_entry.esp0);
+	wrmsr(MSR_SYSENTER_EIP, (uint32_t)trampoline_sysenter_stub);
+	sysenter_on = true;
+}
+
+bool sysenter_enabled(void) {
+	return sysenter_on;
 }
 
 void gdt_get_range(uintptr_t *base, size_t *size) {
@@ -13,6 +13,12 @@ static int display_width = MODE13H_WIDTH;
 static int display_height = MODE13H_HEIGHT;
 static int display_buffer_size = MODE13H_WIDTH * MODE13H_HEIGHT;
 
+// Clip rectangle (exclusive right/bottom); covers the whole display by default
+static int clip_x0 = 0;
+static int clip_y0 = 0;
+static int clip_x1 = MODE13H_WIDTH;
+static int clip_y1 = MODE13H_HEIGHT;
+
 // Double buffering
 static bool double_buffer_enabled = false;
 static uint8_t* back_buffer = NULL;
@@ -143,6 +149,7 @@ static void set_display_dimensions(int width, int height) {
     display_width = width;
     display_height = height;
     display_buffer_size = width * height;
+    graphics_reset_clip();
 }
 
 // Switch to Mode 13h (320x200, 256 colors) using VGA registers
@@ -429,10 +436,36 @@ void graphics_return_to_text(void) {
     graphics_set_mode(MODE_TEXT);
 }
 
+// Clamp [pos, pos + len) to [lo, hi). Coordinates can come straight from
+// user space, so the sum is taken in 64 bits. An empty result has
+// *out_start == *out_end.
+static void graphics_clamp_span(int pos, int len, int lo, int hi, int *out_start, int *out_end) {
+    int64_t start = pos;
+    int64_t end = (int64_t)pos + len;
+    if (start < lo) start = lo;
+    if (start > hi) start = hi;
+    if (end > hi) end = hi;
+    if (end < start) end = start;
+    *out_start = (int)start;
+    *out_end = (int)end;
+}
+
 // Basic drawing primitives
+void graphics_set_clip(int x, int y, int width, int height) {
+    graphics_clamp_span(x, width, 0, display_width, &clip_x0, &clip_x1);
+    graphics_clamp_span(y, height, 0, display_height, &clip_y0, &clip_y1);
+}
+
+void graphics_reset_clip(void) {
+    clip_x0 = 0;
+    clip_y0 = 0;
+    clip_x1 = display_width;
+    clip_y1 = display_height;
+}
+
 void graphics_putpixel(int x, int y, uint8_t color) {
     if (current_mode == MODE_TEXT) return;
-    if (x < 0 || x >= display_width || y < 0 || y >= display_height) return;
+    if (x < clip_x0 || x >= clip_x1 || y < clip_y0 || y >= clip_y1) return;
     
     uint8_t* target = double_buffer_enabled ? back_buffer : VGA_MEMORY;
     target[y * display_width + x] = color;
@@ -494,18 +527,14 @@ void graphics_draw_rect(int x, int y, int width, int height, uint8_t color) {
 void graphics_fill_rect(int x, int y, int width, int height, uint8_t color) {
     if (current_mode == MODE_TEXT) return;
     
-    uint8_t* target = double_buffer_enabled ? back_buffer : VGA_MEMORY;
+    int x0, y0, x1, y1;
+    graphics_clamp_span(x, width, clip_x0, clip_x1, &x0, &x1);
+    graphics_clamp_span(y, height, clip_y0, clip_y1, &y0, &y1);
+    if (x0 >= x1 || y0 >= y1) return;
     
-    for (int j = 0; j < height; j++) {
-        int py = y + j;
-        if (py < 0 || py >= display_height) continue;
-        
-        for (int i = 0; i < width; i++) {
-            int px = x + i;
-            if (px < 0 || px >= display_width) continue;
-            
-            target[py * display_width + px] = color;
-        }
+    uint8_t* target = double_buffer_enabled ? back_buffer : VGA_MEMORY;
+    for (int py = y0; py < y1; py++) {
+        memset(target + py * display_width + x0, color, (size_t)(x1 - x0));
     }
 }
 
@@ -643,33 +672,28 @@ bool graphics_blit_from_user(uint32_t *page_dir, int x, int y, int width, int he
         return false;
     }
 
-    int src_x = 0;
-    int src_y = 0;
-    if (x < 0) {
-        src_x = -x;
-        width += x;
-        x = 0;
-    }
-    if (y < 0) {
-        src_y = -y;
-        height += y;
-        y = 0;
-    }
-    if (x + width > display_width) {
-        width = display_width - x;
-    }
-    if (y + height > display_height) {
-        height = display_height - y;
-    }
-    if (width <= 0 || height <= 0) {
+    int x0, y0, x1, y1;
+    graphics_clamp_span(x, width, clip_x0, clip_x1, &x0, &x1);
+    graphics_clamp_span(y, height, clip_y0, clip_y1, &y0, &y1);
+    if (x0 >= x1 || y0 >= y1) {
         return true;
     }
+    int64_t src_x = (int64_t)x0 - x;
+    int64_t src_y = (int64_t)y0 - y;
     if (src_x >= stride) {
         return false;
     }
+    uint64_t src_offset = (uint64_t)src_y * (uint32_t)stride + (uint64_t)src_x;
+    if (src_offset > UINT32_MAX - user_ptr) {
+        return false;
+    }
+    x = x0;
+    y = y0;
+    width = x1 - x0;
+    height = y1 - y0;
 
     uint8_t* target = double_buffer_enabled ? back_buffer : VGA_MEMORY;
-    uint32_t src_base = user_ptr + (uint32_t)src_y * (uint32_t)stride + (uint32_t)src_x;
+    uint32_t src_base = user_ptr + (uint32_t)src_offset;
 
     for (int row = 0; row < height; row++) {
         uint8_t* dst = target + (y + row) * display_width + x;
@@ -681,6 +705,20 @@ bool graphics_blit_from_user(uint32_t *page_dir, int x, int y, int width, int he
     return true;
 }
 
+// Copy a whole user frame (width * height bytes, no padding) to the screen in
+// one pass, then flip if double buffering is on. Ignores the clip rectangle.
+bool graphics_present_from_user(uint32_t *page_dir, uint32_t user_ptr) {
+    if (current_mode == MODE_TEXT || !page_dir) {
+        return false;
+    }
+    uint8_t* target = double_buffer_enabled ? back_buffer : VGA_MEMORY;
+    if (!page_copy_from_user(page_dir, target, user_ptr, (uint32_t)display_buffer_size)) {
+        return false;
+    }
+    graphics_flip_buffer();
+    return true;
+}
+
 // Scroll screen up by specified number of pixels
 void graphics_scroll_up(int pixels) {
     if (current_mode == MODE_TEXT) return;
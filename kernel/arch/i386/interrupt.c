@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <kernel/interrupt.h>
 #include <kernel/pic.h>
+#include <kernel/apic.h>
 #include <kernel/io.h>
 
 #include <stdint.h>
@@ -15,6 +16,7 @@ extern void syscall_stub(void);
 extern void* trampoline_isr_stub_table[];
 extern void* trampoline_irq_stub_table[];
 extern void trampoline_syscall_stub(void);
+extern void trampoline_spurious_stub(void);
 
 static bool vectors[IDT_MAX_DESCRIPTORS];
 
@@ -72,6 +74,7 @@ void idt_init() {
 
     // System call gate (int 0x80, ring 3) - trap gate keeps IF enabled
     idt_set_descriptor(0x80, trampoline_syscall_stub, 0xEF);
+    idt_set_descriptor(LAPIC_SPURIOUS_VECTOR, trampoline_spurious_stub, 0x8E);
 
     __asm__ volatile ("lidt %0" : : "m"(idtr)); // load the new IDT
 }
@@ -3,30 +3,20 @@
 #include <stddef.h>
 #include <kernel/tty.h>
 #include <kernel/io.h>
+#include <kernel/input.h>
+#include <kernel/keyboard.h>
 
 #define KEYBOARD_DATA_PORT 0x60
 #define KEYBOARD_STATUS_PORT 0x64
 
 #define KEY_BUFFER_SIZE 256
 
-// Special key codes
-#define KEY_UP_ARROW 0x80
-#define KEY_DOWN_ARROW 0x81
-#define KEY_LEFT_ARROW 0x82
-#define KEY_RIGHT_ARROW 0x83
-#define KEY_PAGE_UP 0x84
-#define KEY_PAGE_DOWN 0x85
-#define KEY_ALT_DOWN 0x90
-#define KEY_ALT_UP 0x91
-#define KEY_F4 0x92
-#define KEY_CTRL_DOWN 0x93
-#define KEY_CTRL_UP 0x94
-
 static char key_buffer[KEY_BUFFER_SIZE];
 static int key_buffer_head = 0;
 static int key_buffer_tail = 0;
 static bool shift_pressed = false;
 static bool caps_lock = false;
+static uint8_t keys_down[16];           // One bit per set 1 make code
 
 // US QWERTY keyboard layout scancode to ASCII mapping
 static unsigned char scancode_to_ascii[] = {
@@ -119,10 +109,54 @@ void keyboard_set_typematic(uint8_t delay, uint8_t rate) {
     io_wait();
 }
 
+// Queue a translated key, or hand it to /dev/input while that is open.
+static void keyboard_emit(char c) {
+    if (input_grabbed()) {
+        input_report(INPUT_EV_CHAR, 0, (uint8_t)c);
+        return;
+    }
+    int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
+    if (next_head != key_buffer_tail) {
+        key_buffer[key_buffer_head] = c;
+        key_buffer_head = next_head;
+    }
+}
+
+// Raw key event for /dev/input. E0 prefixes are not tracked, so extended
+// keys (arrows, right ctrl/alt) report the code of their keypad twin.
+static void keyboard_report_raw(uint8_t scancode) {
+    uint8_t code = scancode & 0x7F;
+    uint8_t bit = (uint8_t)(1u << (code & 7));
+    int32_t value;
+    if (scancode & 0x80) {
+        value = INPUT_KEY_RELEASE;
+        keys_down[code >> 3] &= (uint8_t)~bit;
+    } else {
+        value = (keys_down[code >> 3] & bit) ? INPUT_KEY_REPEAT : INPUT_KEY_PRESS;
+        keys_down[code >> 3] |= bit;
+    }
+    input_report(INPUT_EV_KEY, code, value);
+}
+
+static void keyboard_process(uint8_t scancode);
+
 void keyboard_handler(void) {
     uint8_t scancode = inb(KEYBOARD_DATA_PORT);
     io_wait();
-    
+
+    if (!input_grabbed()) {
+        keyboard_process(scancode);
+        return;
+    }
+    if (scancode == 0xE0) {
+        return;
+    }
+    keyboard_report_raw(scancode);
+    keyboard_process(scancode);
+    input_sync();
+}
+
+static void keyboard_process(uint8_t scancode) {
     // Check if key release (bit 7 set)
     if (scancode & 0x80) {
         scancode &= 0x7F;
@@ -132,19 +166,11 @@ void keyboard_handler(void) {
         }
         // Handle ctrl release
         if (scancode == 0x1D) {
-            int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
-            if (next_head != key_buffer_tail) {
-                key_buffer[key_buffer_head] = KEY_CTRL_UP;
-                key_buffer_head = next_head;
-            }
+            keyboard_emit(KEY_CTRL_UP);
         }
         // Handle alt release
         if (scancode == 0x38) {
-            int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
-            if (next_head != key_buffer_tail) {
-                key_buffer[key_buffer_head] = KEY_ALT_UP;
-                key_buffer_head = next_head;
-            }
+            keyboard_emit(KEY_ALT_UP);
         }
     } else {
         // Key press
@@ -156,21 +182,13 @@ void keyboard_handler(void) {
 
         // Handle ctrl press
         if (scancode == 0x1D) {
-            int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
-            if (next_head != key_buffer_tail) {
-                key_buffer[key_buffer_head] = KEY_CTRL_DOWN;
-                key_buffer_head = next_head;
-            }
+            keyboard_emit(KEY_CTRL_DOWN);
             return;
         }
 
         // Handle alt press
         if (scancode == 0x38) {
-            int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
-            if (next_head != key_buffer_tail) {
-                key_buffer[key_buffer_head] = KEY_ALT_DOWN;
-                key_buffer_head = next_head;
-            }
+            keyboard_emit(KEY_ALT_DOWN);
             return;
         }
         
@@ -182,45 +200,25 @@ void keyboard_handler(void) {
 
         // Handle function keys needed by UWM
         if (scancode == 0x3E) { // F4
-            int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
-            if (next_head != key_buffer_tail) {
-                key_buffer[key_buffer_head] = KEY_F4;
-                key_buffer_head = next_head;
-            }
+            keyboard_emit(KEY_F4);
             return;
         }
         
         // Handle arrow keys for history navigation
         if (scancode == 0x48) { // Up arrow
-            int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
-            if (next_head != key_buffer_tail) {
-                key_buffer[key_buffer_head] = KEY_UP_ARROW;
-                key_buffer_head = next_head;
-            }
+            keyboard_emit(KEY_UP_ARROW);
             return;
         }
         if (scancode == 0x50) { // Down arrow
-            int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
-            if (next_head != key_buffer_tail) {
-                key_buffer[key_buffer_head] = KEY_DOWN_ARROW;
-                key_buffer_head = next_head;
-            }
+            keyboard_emit(KEY_DOWN_ARROW);
             return;
         }
         if (scancode == 0x4B) { // Left arrow
-            int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
-            if (next_head != key_buffer_tail) {
-                key_buffer[key_buffer_head] = KEY_LEFT_ARROW;
-                key_buffer_head = next_head;
-            }
+            keyboard_emit(KEY_LEFT_ARROW);
             return;
         }
         if (scancode == 0x4D) { // Right arrow
-            int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
-            if (next_head != key_buffer_tail) {
-                key_buffer[key_buffer_head] = KEY_RIGHT_ARROW;
-                key_buffer_head = next_head;
-            }
+            keyboard_emit(KEY_RIGHT_ARROW);
             return;
         }
         
@@ -239,11 +237,7 @@ void keyboard_handler(void) {
             
             // Add to buffer if valid character
             if (ascii != 0) {
-                int next_head = (key_buffer_head + 1) % KEY_BUFFER_SIZE;
-                if (next_head != key_buffer_tail) {
-                    key_buffer[key_buffer_head] = ascii;
-                    key_buffer_head = next_head;
-                }
+                keyboard_emit(ascii);
             }
         }
     }
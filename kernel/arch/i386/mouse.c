@@ -3,6 +3,7 @@
 #include <kernel/mouse.h>
 #include <kernel/tty.h>
 #include <kernel/io.h>
+#include <kernel/input.h>
 
 #define MOUSE_PORT 0x60
 #define MOUSE_STATUS 0x64
@@ -12,6 +13,36 @@
 static uint8_t mouse_cycle = 0;
 static int8_t mouse_byte[4];
 static mouse_state_t current_state = {0};
+// Set when a packet changed something since the last mouse_get_state.
+static volatile bool state_pending = false;
+// Buttons as last sent to /dev/input.
+static uint8_t reported_buttons = 0;
+
+static const uint16_t button_codes[3] = {
+	INPUT_BTN_LEFT, INPUT_BTN_RIGHT, INPUT_BTN_MIDDLE
+};
+
+// One packet as events: motion, wheel, button changes, then a report.
+static void mouse_report_packet(int8_t dx, int8_t dy, int8_t scroll, uint8_t buttons) {
+	if (dx) {
+		input_report(INPUT_EV_REL, INPUT_REL_X, dx);
+	}
+	if (dy) {
+		input_report(INPUT_EV_REL, INPUT_REL_Y, -dy);
+	}
+	if (scroll) {
+		input_report(INPUT_EV_REL, INPUT_REL_WHEEL, -scroll);
+	}
+	for (int i = 0; i < 3; i++) {
+		uint8_t mask = (uint8_t)(1u << i);
+		if ((buttons ^ reported_buttons) & mask) {
+			input_report(INPUT_EV_KEY, button_codes[i],
+			             (buttons & mask) ? INPUT_KEY_PRESS : INPUT_KEY_RELEASE);
+		}
+	}
+	reported_buttons = buttons;
+	input_sync();
+}
 
 void mouse_wait_output(void) {
 	uint32_t timeout = 100000;
@@ -127,18 +158,30 @@ void mouse_handler(void) {
 			mouse_byte[3] = mouse_in;
 			mouse_cycle = 0;
 			
-			// Parse mouse data
-			current_state.buttons = mouse_byte[0] & 0x07;
-			current_state.x = mouse_byte[1];
-			current_state.y = mouse_byte[2];
-			
 			// Handle scroll wheel from 4th byte
 			int8_t scroll = (int8_t)(mouse_byte[3] & 0x0F);
 			if (scroll & 0x08) {
 				scroll |= 0xF0;
 			}
+
+			if (input_grabbed()) {
+				mouse_report_packet(mouse_byte[1], mouse_byte[2], scroll,
+				                    mouse_byte[0] & 0x07);
+				break;
+			}
+
+			// Parse mouse data
+			if ((mouse_byte[0] & 0x07) != current_state.buttons ||
+				mouse_byte[1] != 0 || mouse_byte[2] != 0) {
+				state_pending = true;
+			}
+			current_state.buttons = mouse_byte[0] & 0x07;
+			current_state.x = mouse_byte[1];
+			current_state.y = mouse_byte[2];
+			
 			if (scroll != 0) {
 				current_state.scroll = scroll;
+				state_pending = true;
 				
 				// Note: Terminal scrolling removed from IRQ handler to prevent
 				// nested I/O operations that cause QEMU mutex issues.
@@ -154,5 +197,10 @@ mouse_state_t mouse_get_state(void) {
 	current_state.x = 0;
 	current_state.y = 0;
 	current_state.scroll = 0;
+	state_pending = false;
 	return state;
 }
+
+bool mouse_has_input(void) {
+	return state_pending;
+}
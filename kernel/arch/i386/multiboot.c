@@ -0,0 +1,141 @@
+#include <kernel/multiboot.h>
+#include <kernel/memory.h>
+#include <kernel/pagings.h>
+#include <stdio.h>
+#include <string.h>
+
+// Assumed when the bootloader gives no memory information (the old fixed layout).
+#define MEMORY_FALLBACK_END 0x02000000
+// Highest page-aligned address representable in a 32-bit region end.
+#define MEMORY_ADDR_LIMIT 0xFFFFF000ULL
+#define MULTIBOOT_CMDLINE_MAX 256
+
+static memory_region_t regions[MEMORY_MAX_REGIONS];
+static uint32_t region_count = 0;
+static char cmdline[MULTIBOOT_CMDLINE_MAX];
+
+static void memory_add_region(uint64_t start, uint64_t end) {
+	if (end > MEMORY_ADDR_LIMIT) {
+		end = MEMORY_ADDR_LIMIT;
+	}
+	// Page-align inwards; never hand out the first page.
+	start = (start + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+	end &= ~(uint64_t)(PAGE_SIZE - 1);
+	if (start < PAGE_SIZE) {
+		start = PAGE_SIZE;
+	}
+	if (start >= end || region_count >= MEMORY_MAX_REGIONS) {
+		return;
+	}
+
+	// Insert sorted by start address, then merge overlapping neighbours.
+	uint32_t pos = region_count;
+	while (pos > 0 && regions[pos - 1].start > start) {
+		regions[pos] = regions[pos - 1];
+		pos--;
+	}
+	regions[pos].start = (uint32_t)start;
+	regions[pos].end = (uint32_t)end;
+	region_count++;
+
+	uint32_t out = 0;
+	for (uint32_t i = 1; i < region_count; i++) {
+		if (regions[i].start <= regions[out].end) {
+			if (regions[i].end > regions[out].end) {
+				regions[out].end = regions[i].end;
+			}
+		} else {
+			regions[++out] = regions[i];
+		}
+	}
+	region_count = out + 1;
+}
+
+void multiboot_init(uint32_t magic, uint32_t info_phys) {
+	region_count = 0;
+	cmdline[0] = '\0';
+
+	if (magic == MULTIBOOT_BOOTLOADER_MAGIC && info_phys != 0) {
+		const multiboot_info_t *info = (const multiboot_info_t *)phys_to_virt(info_phys);
+		// Only the boot page tables are live here, so the string must lie below
+		// BOOT_MAPPED_LIMIT; bootloaders place it in low memory.
+		if ((info->flags & MULTIBOOT_INFO_CMDLINE) && info->cmdline != 0 &&
+		    info->cmdline < BOOT_MAPPED_LIMIT - MULTIBOOT_CMDLINE_MAX) {
+			strncpy(cmdline, (const char *)phys_to_virt(info->cmdline), sizeof(cmdline) - 1);
+			cmdline[sizeof(cmdline) - 1] = '\0';
+		}
+		// The memory map is read through the boot page tables as well.
+		if ((info->flags & MULTIBOOT_INFO_MEM_MAP) &&
+		    info->mmap_addr < BOOT_MAPPED_LIMIT &&
+		    info->mmap_length <= BOOT_MAPPED_LIMIT - info->mmap_addr) {
+			uint32_t cur = info->mmap_addr;
+			uint32_t end = info->mmap_addr + info->mmap_length;
+			while (cur + sizeof(multiboot_mmap_entry_t) <= end) {
+				const multiboot_mmap_entry_t *entry =
+					(const multiboot_mmap_entry_t *)phys_to_virt(cur);
+				if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && entry->len != 0) {
+					memory_add_region(entry->addr, entry->addr + entry->len);
+				}
+				cur += entry->size + sizeof(entry->size);
+			}
+		}
+		if (region_count == 0 && (info->flags & MULTIBOOT_INFO_MEMORY)) {
+			memory_add_region(0x100000, 0x100000 + (uint64_t)info->mem_upper * 1024);
+		}
+	}
+
+	if (region_count == 0) {
+		printf("Memory: no multiboot memory map, assuming %d MB\n",
+		       MEMORY_FALLBACK_END / (1024 * 1024));
+		memory_add_region(0x100000, MEMORY_FALLBACK_END);
+	}
+}
+
+uint32_t memory_region_count(void) {
+	return region_count;
+}
+
+const memory_region_t *memory_region_get(uint32_t idx) {
+	if (idx >= region_count) {
+		return NULL;
+	}
+	return &regions[idx];
+}
+
+uint32_t memory_total_usable(void) {
+	uint32_t total = 0;
+	for (uint32_t i = 0; i < region_count; i++) {
+		total += regions[i].end - regions[i].start;
+	}
+	return total;
+}
+
+bool multiboot_cmdline_has(const char *option) {
+	size_t len = option ? strlen(option) : 0;
+	if (len == 0) {
+		return false;
+	}
+	const char *cur = cmdline;
+	while (*cur) {
+		while (*cur == ' ') {
+			cur++;
+		}
+		const char *word = cur;
+		while (*cur && *cur != ' ') {
+			cur++;
+		}
+		if ((size_t)(cur - word) == len && memcmp(word, option, len) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t memory_low_region_end(void) {
+	for (uint32_t i = 0; i < region_count; i++) {
+		if (regions[i].start <= KERNEL_PHYS_BASE && regions[i].end > KERNEL_PHYS_BASE) {
+			return regions[i].end;
+		}
+	}
+	return 0;
+}
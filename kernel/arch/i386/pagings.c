@@ -1,18 +1,43 @@
 #include <kernel/pagings.h>
 #include <kernel/cpu.h>
 #include <kernel/kmalloc.h>
+#include <kernel/multiboot.h>
+#include <kernel/panic.h>
+#include <stdio.h>
 #include <string.h>
 
 extern void loadPageDirectory(unsigned int*);
 extern void enablePaging();
-
-#define FRAME_POOL_START (HEAP_PHYS_START + HEAP_SIZE)
-#define FRAME_POOL_END USER_SPACE_START
-#define FRAME_COUNT ((FRAME_POOL_END - FRAME_POOL_START) / PAGE_SIZE)
-#define FRAME_BITMAP_SIZE ((FRAME_COUNT + 7) / 8)
-
-static uint8_t frame_bitmap[FRAME_BITMAP_SIZE];
-static uint32_t frame_refcount[FRAME_COUNT];
+extern char kernel_end[];
+
+// Kernel heap sizing: an eighth of RAM within these bounds, leaving at least
+// HEAP_POOL_RESERVE of the low memory region for the frame pool.
+#define HEAP_MIN_SIZE 0x00400000
+#define HEAP_DEFAULT_SIZE 0x01000000
+#define HEAP_MAX_SIZE 0x08000000
+#define HEAP_POOL_RESERVE 0x00800000
+#define PAGE_TABLE_SPAN (1024 * PAGE_SIZE)
+
+// Buddy allocator over the frame pool. Free blocks of 2^order frames are
+// aligned on their physical frame number and linked through the side arrays
+// below (indexed by frame number, linked by frame number rather than by
+// pointer), so frames never need to be mapped to be tracked.
+// frame_order_mask has bit k set while frame_free_heads[k] is non-empty; the
+// order-0 list doubles as a LIFO free-frame stack.
+#define FRAME_MAX_ORDER 10          // 4 MiB blocks
+#define FRAME_NONE 0xFFFFFFFFu
+#define FRAME_ORDER_NONE 0xFF       // Not the first frame of a free block
+
+// Frame pool bounds and side arrays are placed by page_init from the memory map.
+static uint32_t frame_pool_start;
+static uint32_t frame_pool_end;
+static uint32_t frame_count;        // Frames covered by the side arrays
+static uint32_t *frame_refcount;
+static uint32_t *frame_next;
+static uint32_t *frame_prev;
+static uint8_t *frame_order;
+static uint32_t frame_free_heads[FRAME_MAX_ORDER + 1];
+static uint32_t frame_order_mask;
 static uint32_t *kernel_page_directory = NULL;
 
 static inline bool page_in_kernel_heap(uint32_t virt) {
@@ -20,14 +45,14 @@ static inline bool page_in_kernel_heap(uint32_t virt) {
 }
 
 static bool frame_index_from_phys(uint32_t phys, uint32_t *out_idx) {
-	if (phys < FRAME_POOL_START || phys >= FRAME_POOL_END) {
+	if (phys < frame_pool_start || phys >= frame_pool_end) {
 		return false;
 	}
 	if ((phys & (PAGE_SIZE - 1)) != 0) {
 		return false;
 	}
-	uint32_t idx = (phys - FRAME_POOL_START) / PAGE_SIZE;
-	if (idx >= FRAME_COUNT) {
+	uint32_t idx = phys / PAGE_SIZE;
+	if (idx >= frame_count) {
 		return false;
 	}
 	if (out_idx) {
@@ -36,32 +61,147 @@ static bool frame_index_from_phys(uint32_t phys, uint32_t *out_idx) {
 	return true;
 }
 
-static inline bool frame_test(uint32_t idx) {
-	return (frame_bitmap[idx / 8] & (1u << (idx % 8))) != 0;
+static void frame_list_push(uint32_t idx, uint32_t order) {
+	uint32_t head = frame_free_heads[order];
+	frame_order[idx] = (uint8_t)order;
+	frame_prev[idx] = FRAME_NONE;
+	frame_next[idx] = head;
+	if (head != FRAME_NONE) {
+		frame_prev[head] = idx;
+	}
+	frame_free_heads[order] = idx;
+	frame_order_mask |= (1u << order);
+}
+
+static void frame_list_remove(uint32_t idx) {
+	uint32_t order = frame_order[idx];
+	uint32_t prev = frame_prev[idx];
+	uint32_t next = frame_next[idx];
+	if (prev != FRAME_NONE) {
+		frame_next[prev] = next;
+	} else {
+		frame_free_heads[order] = next;
+	}
+	if (next != FRAME_NONE) {
+		frame_prev[next] = prev;
+	}
+	if (frame_free_heads[order] == FRAME_NONE) {
+		frame_order_mask &= ~(1u << order);
+	}
+	frame_order[idx] = FRAME_ORDER_NONE;
+}
+
+// Return a block to the free lists, merging with its buddy where possible
+static void frame_block_free(uint32_t idx, uint32_t order) {
+	while (order < FRAME_MAX_ORDER) {
+		uint32_t buddy = idx ^ (1u << order);
+		if (buddy + (1u << order) > frame_count || frame_order[buddy] != order) {
+			break;
+		}
+		frame_list_remove(buddy);
+		if (buddy < idx) {
+			idx = buddy;
+		}
+		order++;
+	}
+	frame_list_push(idx, order);
 }
 
-static inline void frame_set(uint32_t idx) {
-	frame_bitmap[idx / 8] |= (uint8_t)(1u << (idx % 8));
+// Take a free block of at least 2^order frames and split it down to size
+static uint32_t frame_block_alloc(uint32_t order) {
+	uint32_t candidates = frame_order_mask & ~((1u << order) - 1);
+	if (candidates == 0) {
+		return FRAME_NONE;
+	}
+	uint32_t found = __builtin_ctz(candidates);
+	uint32_t idx = frame_free_heads[found];
+	frame_list_remove(idx);
+	while (found > order) {
+		found--;
+		frame_list_push(idx + (1u << found), found);
+	}
+	return idx;
 }
 
-static inline void frame_clear(uint32_t idx) {
-	frame_bitmap[idx / 8] &= (uint8_t)~(1u << (idx % 8));
+// Carve [start, end) into the largest blocks aligned on their frame number
+static void frame_add_range(uint32_t start, uint32_t end) {
+	uint32_t idx = start / PAGE_SIZE;
+	uint32_t last = end / PAGE_SIZE;
+	while (idx < last) {
+		uint32_t order = idx ? __builtin_ctz(idx) : FRAME_MAX_ORDER;
+		if (order > FRAME_MAX_ORDER) {
+			order = FRAME_MAX_ORDER;
+		}
+		while (idx + (1u << order) > last) {
+			order--;
+		}
+		frame_list_push(idx, order);
+		idx += 1u << order;
+	}
 }
 
 static void frame_init(void) {
-	memset(frame_bitmap, 0, sizeof(frame_bitmap));
-	memset(frame_refcount, 0, sizeof(frame_refcount));
+	memset(frame_refcount, 0, frame_count * sizeof(uint32_t));
+	memset(frame_order, FRAME_ORDER_NONE, frame_count);
+	for (uint32_t i = 0; i <= FRAME_MAX_ORDER; i++) {
+		frame_free_heads[i] = FRAME_NONE;
+	}
+	frame_order_mask = 0;
+
+	// Only usable RAM inside the pool is handed out; holes stay unowned.
+	for (uint32_t i = 0; i < memory_region_count(); i++) {
+		const memory_region_t *region = memory_region_get(i);
+		uint32_t start = region->start > frame_pool_start ? region->start : frame_pool_start;
+		uint32_t end = region->end < frame_pool_end ? region->end : frame_pool_end;
+		if (start < end) {
+			frame_add_range(start, end);
+		}
+	}
 }
 
 uint32_t frame_alloc(void) {
-	for (uint32_t i = 0; i < FRAME_COUNT; i++) {
-		if (!frame_test(i)) {
-			frame_set(i);
-			frame_refcount[i] = 1;
-			return FRAME_POOL_START + i * PAGE_SIZE;
+	uint32_t idx = frame_block_alloc(0);
+	if (idx == FRAME_NONE) {
+		return 0;
+	}
+	frame_refcount[idx] = 1;
+	return idx * PAGE_SIZE;
+}
+
+uint32_t frame_alloc_contiguous(uint32_t count) {
+	if (count == 0) {
+		return 0;
+	}
+	uint32_t order = 0;
+	while ((1u << order) < count) {
+		order++;
+	}
+	if (order > FRAME_MAX_ORDER) {
+		return 0;
+	}
+	uint32_t idx = frame_block_alloc(order);
+	if (idx == FRAME_NONE) {
+		return 0;
+	}
+
+	// Give back the tail of the block beyond the requested count
+	uint32_t block = idx;
+	uint32_t remaining = count;
+	while ((1u << order) != remaining) {
+		order--;
+		uint32_t half = 1u << order;
+		if (remaining <= half) {
+			frame_list_push(block + half, order);
+		} else {
+			block += half;
+			remaining -= half;
 		}
 	}
-	return 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		frame_refcount[idx + i] = 1;
+	}
+	return idx * PAGE_SIZE;
 }
 
 void frame_free(uint32_t phys) {
@@ -73,8 +213,17 @@ void frame_free(uint32_t phys) {
 		frame_refcount[idx]--;
 		return;
 	}
+	if (frame_refcount[idx] == 0) {
+		return;
+	}
 	frame_refcount[idx] = 0;
-	frame_clear(idx);
+	frame_block_free(idx, 0);
+}
+
+void frame_free_contiguous(uint32_t phys, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		frame_free(phys + i * PAGE_SIZE);
+	}
 }
 
 void frame_ref_inc(uint32_t phys) {
@@ -269,11 +418,19 @@ void page_directory_destroy(uint32_t *page_dir) {
 	if (!page_dir || page_dir == kernel_page_directory) {
 		return;
 	}
+	if (read_cr3() == virt_to_phys(page_dir)) {
+		write_cr3(virt_to_phys(kernel_page_directory));
+	}
 	for (uint32_t i = 0; i < 1024; i++) {
 		uint32_t pde = page_dir[i];
 		if ((pde & PAGE_PRESENT) == 0) {
 			continue;
 		}
+		// Tables shared with the kernel directory are not ours to free.
+		if (i >= (KERNEL_VIRT_BASE >> 22) && pde == kernel_page_directory[i]) {
+			page_dir[i] = 0;
+			continue;
+		}
 		uint32_t *table = (uint32_t *)phys_to_virt(pde & ~0xFFF);
 		for (uint32_t j = 0; j < 1024; j++) {
 			uint32_t pte = table[j];
@@ -289,6 +446,31 @@ void page_directory_destroy(uint32_t *page_dir) {
 	frame_free(virt_to_phys(page_dir));
 }
 
+void page_directory_share_kernel(uint32_t *page_dir) {
+	if (!page_dir || page_dir == kernel_page_directory) {
+		return;
+	}
+	for (uint32_t i = KERNEL_VIRT_BASE >> 22; i < 1024; i++) {
+		page_dir[i] = kernel_page_directory[i];
+	}
+}
+
+void page_set_kernel_global(void) {
+	for (uint32_t i = KERNEL_VIRT_BASE >> 22; i < 1024; i++) {
+		uint32_t pde = kernel_page_directory[i];
+		if ((pde & PAGE_PRESENT) == 0) {
+			continue;
+		}
+		uint32_t *table = (uint32_t *)phys_to_virt(pde & ~0xFFF);
+		for (uint32_t j = 0; j < 1024; j++) {
+			if (table[j] & PAGE_PRESENT) {
+				table[j] |= PAGE_GLOBAL;
+			}
+		}
+	}
+	write_cr3(read_cr3());
+}
+
 bool page_translate_flags(uint32_t *page_dir, uint32_t virt, uint32_t *out_phys, uint32_t *out_flags) {
 	if (!page_dir) {
 		return false;
@@ -364,6 +546,24 @@ bool page_copy_from_user(uint32_t *page_dir, void *dst, uint32_t src, uint32_t l
 	return true;
 }
 
+// Translate a user address for writing, breaking copy-on-write first.
+static bool page_translate_writable(uint32_t *page_dir, uint32_t addr, uint32_t *out_phys) {
+	uint32_t flags = 0;
+	if (!page_translate_flags(page_dir, addr, out_phys, &flags)) {
+		return false;
+	}
+	if ((flags & PAGE_RW) == 0) {
+		if ((flags & PAGE_COW) == 0 || !page_handle_cow(page_dir, addr)) {
+			return false;
+		}
+		if (!page_translate_flags(page_dir, addr, out_phys, &flags) ||
+		    (flags & PAGE_RW) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
 bool page_copy_to_user(uint32_t *page_dir, uint32_t dst, const void *src, uint32_t len) {
 	if (!page_dir || !src) {
 		return false;
@@ -373,19 +573,9 @@ bool page_copy_to_user(uint32_t *page_dir, uint32_t dst, const void *src, uint32
 	while (remaining > 0) {
 		uint32_t addr = dst + offset;
 		uint32_t phys = 0;
-		uint32_t flags = 0;
-		if (!page_translate_flags(page_dir, addr, &phys, &flags)) {
+		if (!page_translate_writable(page_dir, addr, &phys)) {
 			return false;
 		}
-		if ((flags & PAGE_RW) == 0) {
-			if ((flags & PAGE_COW) == 0 || !page_handle_cow(page_dir, addr)) {
-				return false;
-			}
-			if (!page_translate_flags(page_dir, addr, &phys, &flags) ||
-			    (flags & PAGE_RW) == 0) {
-				return false;
-			}
-		}
 		uint32_t page_off = addr & (PAGE_SIZE - 1);
 		uint32_t chunk = PAGE_SIZE - page_off;
 		if (chunk > remaining) {
@@ -398,6 +588,33 @@ bool page_copy_to_user(uint32_t *page_dir, uint32_t dst, const void *src, uint32
 	return true;
 }
 
+bool page_copy_user_to_user(uint32_t *dst_dir, uint32_t dst,
+                            uint32_t *src_dir, uint32_t src, uint32_t len) {
+	if (!dst_dir || !src_dir) {
+		return false;
+	}
+	uint32_t offset = 0;
+	while (offset < len) {
+		uint32_t src_phys = 0;
+		uint32_t dst_phys = 0;
+		if (!page_translate(src_dir, src + offset, &src_phys) ||
+		    !page_translate_writable(dst_dir, dst + offset, &dst_phys)) {
+			return false;
+		}
+		uint32_t chunk = PAGE_SIZE - ((src + offset) & (PAGE_SIZE - 1));
+		uint32_t dst_room = PAGE_SIZE - ((dst + offset) & (PAGE_SIZE - 1));
+		if (chunk > dst_room) {
+			chunk = dst_room;
+		}
+		if (chunk > len - offset) {
+			chunk = len - offset;
+		}
+		memcpy(phys_to_virt(dst_phys), phys_to_virt(src_phys), chunk);
+		offset += chunk;
+	}
+	return true;
+}
+
 bool page_memset_user(uint32_t *page_dir, uint32_t dst, int value, uint32_t len) {
 	if (!page_dir) {
 		return false;
@@ -432,23 +649,106 @@ bool page_memset_user(uint32_t *page_dir, uint32_t dst, int value, uint32_t len)
 	return true;
 }
 
+static inline uint32_t page_align_up(uint32_t value) {
+	return (value + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+// Bytes of early boot data needed to direct-map and track `mapped` bytes
+static uint32_t page_early_bytes(uint32_t mapped) {
+	uint32_t frames = mapped / PAGE_SIZE;
+	uint32_t tables = (mapped + PAGE_TABLE_SPAN - 1) / PAGE_TABLE_SPAN;
+	uint32_t meta = frames * (3 * sizeof(uint32_t) + sizeof(uint8_t));
+	return PAGE_SIZE + tables * PAGE_SIZE + page_align_up(meta);
+}
+
 void page_init(void) {
-	frame_init();
+	// Map as much RAM as fits below the kernel stack region.
+	uint32_t mapped = 0;
+	for (uint32_t i = 0; i < memory_region_count(); i++) {
+		const memory_region_t *region = memory_region_get(i);
+		if (region->end > mapped) {
+			mapped = region->end;
+		}
+	}
+	if (mapped > KERNEL_DIRECT_MAP_MAX) {
+		mapped = KERNEL_DIRECT_MAP_MAX;
+	}
 
-	uint32_t dir_phys = frame_alloc();
-	if (!dir_phys) {
-		return;
+	// Page directory, direct-map page tables, and frame side arrays are carved
+	// from just past the kernel image, which the boot page tables still cover.
+	uint32_t early = page_align_up(virt_to_phys(kernel_end));
+	if (early + page_early_bytes(mapped) > BOOT_MAPPED_LIMIT) {
+		mapped = BOOT_MAPPED_LIMIT;
+	}
+	uint32_t dir_phys = early;
+	uint32_t tables_phys = dir_phys + PAGE_SIZE;
+	uint32_t table_count = (mapped + PAGE_TABLE_SPAN - 1) / PAGE_TABLE_SPAN;
+	uint32_t meta_phys = tables_phys + table_count * PAGE_SIZE;
+	early += page_early_bytes(mapped);
+
+	frame_count = mapped / PAGE_SIZE;
+	frame_refcount = (uint32_t *)phys_to_virt(meta_phys);
+	frame_next = frame_refcount + frame_count;
+	frame_prev = frame_next + frame_count;
+	frame_order = (uint8_t *)(frame_prev + frame_count);
+
+	// Kernel heap follows the early data; the frame pool gets the rest.
+	uint32_t low_end = memory_low_region_end();
+	if (low_end > mapped) {
+		low_end = mapped;
+	}
+	uint32_t heap_size = memory_total_usable() / 8;
+	if (heap_size < HEAP_DEFAULT_SIZE) {
+		heap_size = HEAP_DEFAULT_SIZE;
+	}
+	if (heap_size > HEAP_MAX_SIZE) {
+		heap_size = HEAP_MAX_SIZE;
 	}
+	if (early + heap_size + HEAP_POOL_RESERVE > low_end) {
+		if (low_end <= early + HEAP_POOL_RESERVE + HEAP_MIN_SIZE) {
+			panic("page_init: not enough low memory for the kernel heap");
+		}
+		heap_size = low_end - early - HEAP_POOL_RESERVE;
+	}
+	heap_size &= ~(PAGE_SIZE - 1);
+	kernel_heap_phys_start = early;
+	kernel_heap_size = heap_size;
+
+	frame_pool_start = early + heap_size;
+	frame_pool_end = mapped;
+	frame_init();
+
 	kernel_page_directory = (uint32_t *)phys_to_virt(dir_phys);
 	memset(kernel_page_directory, 0, PAGE_SIZE);
-
-	for (uint32_t phys = 0; phys < USER_SPACE_START; phys += PAGE_SIZE) {
-		uint32_t virt = phys + KERNEL_VIRT_BASE;
-		if (!page_map(kernel_page_directory, virt, phys, PAGE_RW)) {
-			return;
+	uint32_t kernel_pde = KERNEL_VIRT_BASE >> 22;
+	for (uint32_t t = 0; t < table_count; t++) {
+		uint32_t *table = (uint32_t *)phys_to_virt(tables_phys + t * PAGE_SIZE);
+		for (uint32_t i = 0; i < 1024; i++) {
+			uint32_t phys = t * PAGE_TABLE_SPAN + i * PAGE_SIZE;
+			table[i] = (phys < mapped) ? (phys | PAGE_PRESENT | PAGE_RW) : 0;
 		}
+		kernel_page_directory[kernel_pde + t] = (tables_phys + t * PAGE_SIZE) | PAGE_PRESENT | PAGE_RW;
 	}
 
 	loadPageDirectory((unsigned int *)dir_phys);
 	enablePaging();
+
+	// Kernel stack tables exist up front so the kernel half of this
+	// directory never changes and process directories can share it.
+	for (uint32_t virt = KERNEL_STACK_REGION_BASE;
+	     virt < KERNEL_STACK_REGION_BASE + KERNEL_STACK_REGION_SIZE;
+	     virt += PAGE_TABLE_SPAN) {
+		uint32_t table_phys = frame_alloc();
+		if (!table_phys) {
+			printf("page_init: out of frames for kernel stack tables\n");
+			break;
+		}
+		memset(phys_to_virt(table_phys), 0, PAGE_SIZE);
+		kernel_page_directory[virt >> 22] = table_phys | PAGE_PRESENT | PAGE_RW;
+	}
+
+	printf("Memory: %d MB usable, %d MB mapped, heap %d MB, frame pool %d MB\n",
+	       memory_total_usable() / (1024 * 1024), mapped / (1024 * 1024),
+	       heap_size / (1024 * 1024),
+	       (frame_pool_end - frame_pool_start) / (1024 * 1024));
 }
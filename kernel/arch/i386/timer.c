@@ -1,8 +1,18 @@
 #include <kernel/io.h>
 #include <kernel/interrupt.h>
+#include <kernel/apic.h>
+#include <kernel/cpu.h>
+#include <kernel/ktimer.h>
+#include <kernel/memory.h>
+#include <kernel/multiboot.h>
+#include <kernel/pagings.h>
+#include <kernel/pic.h>
 #include <kernel/task.h>
 #include <kernel/process.h>
+#include <kernel/timer.h>
+#include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 // PIT (Programmable Interval Timer) ports
 #define PIT_CHANNEL0    0x40
@@ -24,22 +34,209 @@
 #define PIT_MSB         0x20    // Access mode: hibyte only
 #define PIT_BOTH        0x30    // Access mode: lobyte/hibyte
 
+#define PIT_SELECT_CH2  0x80    // Command targets channel 2
+
 // PIT frequency (Hz)
 #define PIT_FREQUENCY   1193182
 
-// Desired timer frequency (Hz) - 100 Hz = 10ms per tick
-#define TIMER_FREQUENCY 100
+// PIT channel 2 is gated through port 0x61 and its output can be polled
+// there, which makes it usable for calibration without interrupts.
+#define PIT_GATE_PORT       0x61
+#define PIT_GATE_CH2        0x01
+#define PIT_SPEAKER_DATA    0x02
+#define PIT_OUT_CH2         0x20
+#define TIMER_CALIBRATE_MS  10
 
-static volatile uint32_t timer_ticks = 0;
+// TSC cycles are scaled to ns as cycles * tsc_mult >> TIMER_TSC_SHIFT
+#define TIMER_TSC_SHIFT     24
 
-// Timer interrupt handler
-void timer_handler(trap_frame_t *frame) {
-    timer_ticks++;
-    
-    // Tick the kernel task scheduler (kernel threads)
+// The local APIC timer is delivered on IRQ0's vector (IRQ0 stays masked).
+#define TIMER_VECTOR    0x20
+// Longest an idle CPU sleeps before checking in
+#define TIMER_IDLE_MAX_MS 1000
+
+static volatile uint32_t timer_ticks = 0;   // Scheduler ticks at TIMER_FREQUENCY
+static volatile uint32_t timer_ms = 0;      // Milliseconds since boot
+static uint32_t tick_remainder_ms = 0;      // ms since the last whole tick
+static uint64_t timer_uptime_ms = 0;        // timer_ms without the wrap
+
+// Monotonic clocksource: the TSC scaled to ns against the boot-time value,
+// published read-only to user space through the vclock page.
+static uint32_t tsc_mult = 0;
+static uint64_t tsc_base = 0;
+static uint32_t vclock_frame = 0;
+
+// With the local APIC the timer runs one-shot: each interrupt programs the
+// next deadline, either the next scheduler tick or an earlier ktimer. An
+// idle CPU skips the scheduler ticks and sleeps until the next ktimer.
+static bool timer_lapic = false;
+static uint32_t lapic_counts_per_ms = 0;
+static uint32_t lapic_max_ms = 0;
+static uint32_t lapic_armed = 0;            // Count left at the last read
+static uint32_t lapic_carry = 0;            // Counts not yet folded into ms
+static uint64_t lapic_tsc_mark = 0;         // TSC at the last read
+
+static uint64_t timer_tsc_to_ns(uint64_t delta) {
+    uint32_t lo = (uint32_t)delta;
+    uint32_t hi = (uint32_t)(delta >> 32);
+    return (((uint64_t)hi * tsc_mult) << (32 - TIMER_TSC_SHIFT)) +
+           (((uint64_t)lo * tsc_mult) >> TIMER_TSC_SHIFT);
+}
+
+// Move the clock forward and run whatever became due.
+static void timer_advance(uint32_t elapsed_ms) {
+    if (elapsed_ms == 0) {
+        return;
+    }
+    timer_ms += elapsed_ms;
+    timer_uptime_ms += elapsed_ms;
+    tick_remainder_ms += elapsed_ms;
+    uint32_t ticks = tick_remainder_ms / TIMER_TICK_MS;
+    tick_remainder_ms %= TIMER_TICK_MS;
+    ktimer_run(timer_ms);
+    if (ticks == 0) {
+        return;
+    }
+    timer_ticks += ticks;
+
+    // Tick the kernel task scheduler (kernel threads). Ticks skipped while
+    // idle are not charged to anyone, so one call covers them all.
     task_scheduler_tick();
     process_tick(timer_ticks);
+}
+
+// Add the APIC counts consumed since the last read to the carry. An
+// expired one-shot reads 0 however long ago it fired, so the overrun until
+// now is measured on the TSC when there is one.
+static void timer_lapic_collect(void) {
+    uint32_t current = lapic_timer_current();
+    uint32_t consumed = lapic_armed - current;
+    uint64_t now = tsc_mult ? rdtsc() : 0;
+    if (current == 0 && tsc_mult) {
+        uint64_t counts = timer_tsc_to_ns(now - lapic_tsc_mark) * lapic_counts_per_ms / 1000000;
+        if (counts > 0x7FFFFFFF) {
+            counts = 0x7FFFFFFF;
+        }
+        if (counts > consumed) {
+            consumed = (uint32_t)counts;
+        }
+    }
+    lapic_tsc_mark = now;
+    lapic_armed = current;
+    lapic_carry += consumed;
+}
+
+// Fold the APIC counts consumed since the last read into the clock.
+static void timer_lapic_sync(void) {
+    timer_lapic_collect();
+    uint32_t ms = lapic_carry / lapic_counts_per_ms;
+    lapic_carry -= ms * lapic_counts_per_ms;
+    timer_advance(ms);
+}
+
+static void timer_lapic_arm(bool idle) {
+    uint32_t delay = idle ? lapic_max_ms : TIMER_TICK_MS - tick_remainder_ms;
+    uint32_t until = ktimer_next_event(timer_ms + delay) - timer_ms;
+    if ((int32_t)until < 1) {
+        until = 1;
+    }
+    if (until < delay) {
+        delay = until;
+    }
+    // Counts that ran since the sync belong to the old deadline; keep them
+    // in the carry so re-arming loses no time.
+    timer_lapic_collect();
+    uint32_t count = delay * lapic_counts_per_ms;
+    lapic_armed = count > lapic_carry ? count - lapic_carry : 1;
+    lapic_timer_oneshot(TIMER_VECTOR, lapic_armed);
+}
+
+// Timer interrupt handler
+void timer_handler(trap_frame_t *frame) {
+    if (timer_lapic) {
+        timer_lapic_sync();
+        timer_lapic_arm(false);
+    } else {
+        timer_advance(TIMER_TICK_MS);
+    }
     process_schedule(frame);
+
+    if (timer_lapic) {
+        lapic_eoi();
+    } else {
+        PIC_sendEOI(0);
+    }
+}
+
+// Count TSC cycles and APIC timer counts across one PIT channel 2 window.
+// Either source may be skipped; returns false if the PIT never signalled.
+static bool timer_calibrate(bool tsc, bool lapic, uint64_t *tsc_per_ms, uint32_t *lapic_per_ms) {
+    uint32_t pit_count = PIT_FREQUENCY * TIMER_CALIBRATE_MS / 1000;
+
+    // Gate low (and speaker off) while loading channel 2 in one-shot mode.
+    uint8_t gate = inb(PIT_GATE_PORT);
+    outb(PIT_GATE_PORT, gate & ~(PIT_GATE_CH2 | PIT_SPEAKER_DATA));
+    outb(PIT_COMMAND, PIT_SELECT_CH2 | PIT_BOTH | PIT_MODE0 | PIT_BINARY);
+    outb(PIT_CHANNEL2, pit_count & 0xFF);
+    outb(PIT_CHANNEL2, (pit_count >> 8) & 0xFF);
+
+    if (lapic) {
+        lapic_timer_start_masked(0xFFFFFFFF);
+    }
+    uint64_t tsc_start = tsc ? rdtsc() : 0;
+    outb(PIT_GATE_PORT, (gate & ~PIT_SPEAKER_DATA) | PIT_GATE_CH2);
+
+    uint32_t spins = 0;
+    while ((inb(PIT_GATE_PORT) & PIT_OUT_CH2) == 0 && ++spins < 10000000) {
+    }
+    uint64_t tsc_end = tsc ? rdtsc() : 0;
+    uint32_t lapic_elapsed = lapic ? 0xFFFFFFFF - lapic_timer_current() : 0;
+    if (lapic) {
+        lapic_timer_oneshot(0, 0);
+    }
+    outb(PIT_GATE_PORT, gate & ~PIT_SPEAKER_DATA);
+
+    if (spins >= 10000000) {
+        return false;
+    }
+    *tsc_per_ms = (tsc_end - tsc_start) / TIMER_CALIBRATE_MS;
+    *lapic_per_ms = lapic_elapsed / TIMER_CALIBRATE_MS;
+    return true;
+}
+
+static bool timer_tsc_invariant(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000007) {
+        return false;
+    }
+    cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_APM_EDX_INVARIANT_TSC) != 0;
+}
+
+// Start the TSC clocksource and publish it on the vclock page.
+static void timer_tsc_init(uint64_t tsc_per_ms) {
+    if (tsc_per_ms == 0) {
+        return;
+    }
+    uint64_t mult = (1000000ULL << TIMER_TSC_SHIFT) / tsc_per_ms;
+    if (mult == 0 || mult > 0xFFFFFFFF) {
+        return;
+    }
+    tsc_mult = (uint32_t)mult;
+    tsc_base = rdtsc();
+
+    vclock_frame = frame_alloc();
+    if (vclock_frame) {
+        timer_vclock_t *vclock = (timer_vclock_t *)phys_to_virt(vclock_frame);
+        memset(vclock, 0, PAGE_SIZE);
+        vclock->tsc_mult = tsc_mult;
+        vclock->tsc_shift = TIMER_TSC_SHIFT;
+        vclock->tsc_base = tsc_base;
+    }
+    // Without an invariant TSC the rate may drift with power states.
+    printf("Timer: TSC clocksource at %u kHz%s\n", (uint32_t)tsc_per_ms,
+           timer_tsc_invariant() ? "" : " (not invariant)");
 }
 
 // Initialize the PIT
@@ -53,7 +250,55 @@ void timer_init(uint32_t frequency) {
     // Send frequency divisor
     outb(PIT_CHANNEL0, divisor & 0xFF);         // Low byte
     outb(PIT_CHANNEL0, (divisor >> 8) & 0xFF);  // High byte
-    
+
+    // Prefer the local APIC timer for one-shot deadlines; "nolapic" keeps
+    // the periodic PIT. "notsc" falls back to the tick clock for timestamps.
+    bool lapic = !multiboot_cmdline_has("nolapic") && lapic_init();
+    bool tsc = cpu_has_feature(CPUID_FEAT_EDX_TSC) && !multiboot_cmdline_has("notsc");
+    uint64_t tsc_per_ms = 0;
+    if ((lapic || tsc) && timer_calibrate(tsc, lapic, &tsc_per_ms, &lapic_counts_per_ms)) {
+        timer_tsc_init(tsc_per_ms);
+    }
+    if (lapic_counts_per_ms != 0 && 0x7FFFFFFF / lapic_counts_per_ms >= TIMER_TICK_MS) {
+        timer_lapic = true;
+        lapic_max_ms = 0x7FFFFFFF / lapic_counts_per_ms;
+        if (lapic_max_ms > TIMER_IDLE_MAX_MS) {
+            lapic_max_ms = TIMER_IDLE_MAX_MS;
+        }
+        printf("Timer: local APIC one-shot, %u counts/ms, tickless idle\n",
+               lapic_counts_per_ms);
+    } else {
+        printf("Timer: PIT at %u Hz\n", frequency);
+    }
+}
+
+// Start delivering timer interrupts (after the PIC has been set up).
+void timer_enable(void) {
+    if (timer_lapic) {
+        IRQ_set_mask(0);
+        lapic_tsc_mark = tsc_mult ? rdtsc() : 0;
+        timer_lapic_arm(false);
+    } else {
+        IRQ_clear_mask(0);
+    }
+}
+
+// Halt until the next interrupt. With the APIC timer the scheduler tick is
+// suspended meanwhile, so an idle CPU only wakes for ktimers and devices.
+void timer_idle(void) {
+    uint32_t flags = read_eflags();
+    if (!timer_lapic || !(flags & EFLAGS_IF) || task_ready_any()) {
+        cpu_hlt();
+        return;
+    }
+    cpu_cli();
+    timer_lapic_sync();
+    timer_lapic_arm(true);
+    __asm__ volatile ("sti; hlt; cli");
+    // Catch up on the time spent halted and restore the scheduler tick.
+    timer_lapic_sync();
+    timer_lapic_arm(false);
+    cpu_sti();
 }
 
 // Get current tick count
@@ -61,26 +306,50 @@ uint32_t timer_get_ticks(void) {
     return timer_ticks;
 }
 
-// Sleep for specified milliseconds (busy wait for now)
+uint32_t timer_get_ms(void) {
+    return timer_ms;
+}
+
+uint64_t timer_get_ns(void) {
+    if (tsc_mult) {
+        return timer_tsc_to_ns(rdtsc() - tsc_base);
+    }
+    uint32_t flags = read_eflags();
+    cpu_cli();
+    uint64_t ms = timer_uptime_ms;
+    if (flags & EFLAGS_IF) {
+        cpu_sti();
+    }
+    return ms * 1000000;
+}
+
+uint32_t timer_vclock_frame(void) {
+    return vclock_frame;
+}
+
+static void timer_sleep_wakeup(ktimer_t *timer, void *data) {
+    (void)timer;
+    (void)data;
+}
+
+// Sleep for specified milliseconds
 void timer_sleep_ms(uint32_t ms) {
     if (ms == 0) {
         return;
     }
 
     if (task_current()) {
-        uint32_t ticks = (ms * TIMER_FREQUENCY + 999) / 1000;
-        if (ticks == 0) {
-            ticks = 1;
-        }
-        task_sleep(ticks);
+        task_sleep_ms(ms);
         return;
     }
 
-    uint32_t target = timer_ticks + (ms * TIMER_FREQUENCY) / 1000;
-    if (target == timer_ticks) {
-        target++;
-    }
-    while (timer_ticks < target) {
-        __asm__ volatile ("hlt");
+    // The timer only exists to end timer_idle() on time.
+    uint32_t target = timer_ms + ms;
+    ktimer_t wakeup;
+    ktimer_init(&wakeup, timer_sleep_wakeup, NULL);
+    ktimer_add(&wakeup, target);
+    while ((int32_t)(timer_ms - target) < 0) {
+        timer_idle();
     }
+    ktimer_cancel(&wakeup);
 }
@@ -0,0 +1,22 @@
+#ifndef _KERNEL_APIC_H
+#define _KERNEL_APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Vector for spurious local APIC interrupts (needs no EOI).
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+// Map and enable the local APIC in virtual wire mode, so the PIC keeps
+// delivering legacy IRQs. Returns false if the CPU has no usable APIC.
+bool lapic_init(void);
+bool lapic_available(void);
+void lapic_eoi(void);
+
+// Count down from `count` without raising an interrupt (for calibration).
+void lapic_timer_start_masked(uint32_t count);
+// Fire `vector` once after `count` timer counts; 0 stops the timer.
+void lapic_timer_oneshot(uint8_t vector, uint32_t count);
+uint32_t lapic_timer_current(void);
+
+#endif
@@ -28,6 +28,9 @@
 #define CPUID_FEAT_EDX_SSE          (1 << 25)
 #define CPUID_FEAT_EDX_SSE2         (1 << 26)
 
+// CPUID 0x80000007 (advanced power management) EDX
+#define CPUID_APM_EDX_INVARIANT_TSC (1 << 8)
+
 // CR0 bits
 #define CR0_PE  (1 << 0)   // Protected Mode Enable
 #define CR0_MP  (1 << 1)   // Monitor co-processor
@@ -54,6 +57,16 @@
 #define CR4_OSFXSR     (1 << 9)   // Operating system support for FXSAVE and FXRSTOR
 #define CR4_OSXMMEXCPT (1 << 10)  // Operating System Support for Unmasked SIMD Floating-Point Exceptions
 
+// EFLAGS bits
+#define EFLAGS_TF      (1 << 8)   // Trap (single step)
+#define EFLAGS_IF      (1 << 9)   // Interrupt enable
+
+// Model-specific registers
+#define MSR_APIC_BASE    0x1B
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
 // CPU vendor strings
 typedef struct {
 	char vendor[13];
@@ -0,0 +1,36 @@
+#ifndef _KERNEL_FPU_H
+#define _KERNEL_FPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Lazy FPU/SSE switching. Each process gets a save area on its first FPU
+// instruction. CR0.TS is set whenever a process other than the register
+// owner runs, so the first FPU instruction traps (#NM) and only then are
+// the registers saved and reloaded. Processes that never touch the FPU
+// pay nothing.
+//
+// Kernel code that traps inside a system call is given the current
+// process's registers; outside any process the owner's state is saved and
+// the kernel runs without an owner.
+
+#define FPU_STATE_SIZE 512
+
+typedef struct fpu_state {
+	uint8_t data[FPU_STATE_SIZE];  // FXSAVE image (FNSAVE without FXSR)
+} __attribute__((aligned(16))) fpu_state_t;
+
+struct process;
+
+// Enable the FPU (and SSE if present) and arm the lazy switch.
+void fpu_init(void);
+// Handle #NM. Returns false if the faulting process could not get a save area.
+bool fpu_handle_trap(bool user);
+// Called when `proc` is about to run.
+void fpu_switch(struct process *proc);
+// Give the child a copy of the parent's registers.
+bool fpu_fork(struct process *parent, struct process *child);
+// Forget a process's state (exec, exit).
+void fpu_release(struct process *proc);
+
+#endif
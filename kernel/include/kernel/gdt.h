@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 // GDT selectors
 #define GDT_KERNEL_CODE 0x08
@@ -17,6 +18,10 @@ void gdt_init(void);
 // Update kernel stack used on ring transitions.
 void tss_set_kernel_stack(uint32_t stack_top);
 
+// Program the SYSENTER MSRs if the CPU supports fast system calls.
+void sysenter_init(void);
+bool sysenter_enabled(void);
+
 // Expose descriptor tables for KPTI mapping.
 void gdt_get_range(uintptr_t *base, size_t *size);
 void tss_get_range(uintptr_t *base, size_t *size);
@@ -55,6 +55,10 @@ void graphics_fill_rect(int x, int y, int width, int height, uint8_t color);
 void graphics_draw_circle(int cx, int cy, int radius, uint8_t color);
 void graphics_fill_circle(int cx, int cy, int radius, uint8_t color);
 
+// Restrict drawing to a rectangle (clipped to the display); reset on mode change
+void graphics_set_clip(int x, int y, int width, int height);
+void graphics_reset_clip(void);
+
 // Double buffering
 void graphics_enable_double_buffer(void);
 void graphics_disable_double_buffer(void);
@@ -68,6 +72,7 @@ void graphics_draw_char(int x, int y, char c, uint8_t fg_color, uint8_t bg_color
 void graphics_scroll_up(int pixels);
 bool graphics_blit_from_user(uint32_t *page_dir, int x, int y, int width, int height,
                              int stride, uint32_t user_ptr);
+bool graphics_present_from_user(uint32_t *page_dir, uint32_t user_ptr);
 
 // Screen dimensions
 int graphics_get_width(void);
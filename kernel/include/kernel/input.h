@@ -0,0 +1,59 @@
+#ifndef _KERNEL_INPUT_H
+#define _KERNEL_INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Input event queue, read by user space through /dev/input. The keyboard
+// and mouse IRQ handlers append evdev-style events; each key press or mouse
+// packet ends with an INPUT_SYN_REPORT. While a process holds /dev/input
+// open it "grabs" the devices: events go only to this queue, and the key
+// buffer and mouse_get_state see nothing. Without a grab nothing is queued.
+
+#define INPUT_EV_SYN  0x00
+#define INPUT_EV_KEY  0x01
+#define INPUT_EV_REL  0x02
+// Not in evdev: the byte the key buffer would have received for a key
+// press (ASCII or one of the KEY_* codes in keyboard.c), as `value`.
+#define INPUT_EV_CHAR 0x10
+
+#define INPUT_SYN_REPORT  0
+#define INPUT_SYN_DROPPED 3         // Queue overflowed; earlier events lost
+
+#define INPUT_REL_X     0x00        // Positive to the right
+#define INPUT_REL_Y     0x01        // Positive downwards
+#define INPUT_REL_WHEEL 0x08        // Positive away from the user
+
+// EV_KEY codes: keyboard keys use the set 1 make code; mouse buttons these.
+#define INPUT_BTN_LEFT   0x110
+#define INPUT_BTN_RIGHT  0x111
+#define INPUT_BTN_MIDDLE 0x112
+
+// EV_KEY values
+#define INPUT_KEY_RELEASE 0
+#define INPUT_KEY_PRESS   1
+#define INPUT_KEY_REPEAT  2
+
+#define INPUT_QUEUE_SIZE 256        // Events, a power of two
+
+typedef struct {
+	uint64_t time_ns;               // timer_get_ns() when it happened
+	uint16_t type;
+	uint16_t code;
+	int32_t value;
+} input_event_t;
+
+// Called from the IRQ handlers.
+void input_report(uint16_t type, uint16_t code, int32_t value);
+void input_sync(void);
+bool input_grabbed(void);
+
+// Opens and closes of /dev/input; the devices are grabbed while any is open.
+void input_open(void);
+void input_close(void);
+
+bool input_has_events(void);
+// Move up to `max` queued events to `out`. Returns how many.
+uint32_t input_read(input_event_t *out, uint32_t max);
+
+#endif
@@ -4,6 +4,19 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+// Special key codes returned by keyboard_getchar
+#define KEY_UP_ARROW 0x80
+#define KEY_DOWN_ARROW 0x81
+#define KEY_LEFT_ARROW 0x82
+#define KEY_RIGHT_ARROW 0x83
+#define KEY_PAGE_UP 0x84
+#define KEY_PAGE_DOWN 0x85
+#define KEY_ALT_DOWN 0x90
+#define KEY_ALT_UP 0x91
+#define KEY_F4 0x92
+#define KEY_CTRL_DOWN 0x93
+#define KEY_CTRL_UP 0x94
+
 void keyboard_init(void);
 void keyboard_handler(void);
 bool keyboard_has_input(void);
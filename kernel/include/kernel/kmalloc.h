@@ -6,10 +6,13 @@
 #include <stdbool.h>
 #include <kernel/memory.h>
 
-// Heap configuration
-#define HEAP_PHYS_START 0x00400000  // Physical start of heap (4MB)
+// Heap configuration. Placement and size are chosen by page_init from the
+// amount of physical memory; the defaults match the old fixed layout.
+extern uint32_t kernel_heap_phys_start;
+extern uint32_t kernel_heap_size;
+#define HEAP_PHYS_START kernel_heap_phys_start
 #define HEAP_START (KERNEL_VIRT_BASE + HEAP_PHYS_START)
-#define HEAP_SIZE  0x01000000  // Heap size (16MB)
+#define HEAP_SIZE  kernel_heap_size
 #define HEAP_BLOCK_SIZE 64     // Minimum allocation unit (64 bytes)
 #define HEAP_BLOCKS (HEAP_SIZE / HEAP_BLOCK_SIZE)
 
@@ -3,13 +3,19 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <kernel/trap_frame.h>
 
 struct process;
 
 void kpti_init(void);
-void kpti_map_kernel_pages(uint32_t *page_dir, struct process *proc);
-void kpti_prepare_return_trap(trap_frame_t *frame);
-void kpti_prepare_return_isr(void *frame);
+bool kpti_enabled(void);
+bool kpti_map_kernel_pages(uint32_t *page_dir, struct process *proc);
+
+// Called on every return from the kernel. Returns the frame address to
+// return from: a frame bound for user mode is moved onto the process's own
+// kernel stack, the only kernel stack mapped in its directory.
+uint32_t kpti_prepare_return_trap(trap_frame_t *frame);
+uint32_t kpti_prepare_return_isr(void *frame);
 
 #endif
@@ -0,0 +1,41 @@
+#ifndef _KERNEL_KTIMER_H
+#define _KERNEL_KTIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// One-shot kernel timers on a hierarchical timer wheel with millisecond
+// slots, driven by the timer interrupt (see timer_get_ms). Adding,
+// cancelling and expiring a timer are O(1); an interrupt only touches the
+// timers that expire on it (plus an occasional cascade).
+//
+// Callbacks run from the timer interrupt with interrupts disabled. They may
+// re-add their own timer or add and cancel others, but must not block.
+
+typedef struct ktimer ktimer_t;
+typedef void (*ktimer_fn_t)(ktimer_t *timer, void *data);
+
+struct ktimer {
+	ktimer_t *next;
+	ktimer_t **pprev;       // Link that points at this timer, NULL if idle
+	uint32_t expires;       // Absolute time in ms (timer_get_ms)
+	ktimer_fn_t fn;
+	void *data;
+};
+
+void ktimer_init(ktimer_t *timer, ktimer_fn_t fn, void *data);
+// Arm (or re-arm) the timer to fire at the given time. A time that has
+// already passed fires on the next timer interrupt.
+void ktimer_add(ktimer_t *timer, uint32_t expires);
+// Disarm the timer. Returns true if it was pending.
+bool ktimer_cancel(ktimer_t *timer);
+bool ktimer_pending(const ktimer_t *timer);
+
+// Expire every timer due at or before `now` (called from the timer handler).
+void ktimer_run(uint32_t now);
+// Earliest pending expiry, or `limit` if nothing is due before it. Only
+// expiries matter: ktimer_run cascades for every tick it catches up on.
+// Call with interrupts disabled.
+uint32_t ktimer_next_event(uint32_t limit);
+
+#endif
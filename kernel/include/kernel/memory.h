@@ -6,6 +6,17 @@
 #define KERNEL_VIRT_BASE 0xC0000000
 #define KERNEL_PHYS_BASE 0x00100000
 
+// Physical memory is mapped linearly at KERNEL_VIRT_BASE up to the kernel
+// stack region, which holds guard-paged stacks for processes and tasks.
+#define KERNEL_STACK_REGION_BASE 0xF0000000
+#define KERNEL_STACK_REGION_SIZE 0x00400000
+#define KERNEL_DIRECT_MAP_MAX (KERNEL_STACK_REGION_BASE - KERNEL_VIRT_BASE)
+// Device registers (local APIC) are mapped uncached just above the stacks.
+#define KERNEL_MMIO_BASE (KERNEL_STACK_REGION_BASE + KERNEL_STACK_REGION_SIZE)
+
+// Physical range mapped by the bootstrap page tables in boot.S.
+#define BOOT_MAPPED_LIMIT 0x02000000
+
 #define KERNEL_PHYS_TO_VIRT(addr) ((void *)((uint32_t)(addr) + KERNEL_VIRT_BASE))
 #define KERNEL_VIRT_TO_PHYS(addr) ((uint32_t)(addr) - KERNEL_VIRT_BASE)
 
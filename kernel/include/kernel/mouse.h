@@ -21,6 +21,8 @@ typedef struct {
 void mouse_init(void);
 void mouse_handler(void);
 mouse_state_t mouse_get_state(void);
+// True if the state changed since the last mouse_get_state
+bool mouse_has_input(void);
 void mouse_wait_output(void);
 void mouse_wait_input(void);
 void mouse_write(uint8_t data);
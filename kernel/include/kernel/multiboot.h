@@ -0,0 +1,57 @@
+#ifndef _KERNEL_MULTIBOOT_H
+#define _KERNEL_MULTIBOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+// multiboot_info_t flags
+#define MULTIBOOT_INFO_MEMORY   (1 << 0)
+#define MULTIBOOT_INFO_CMDLINE  (1 << 2)
+#define MULTIBOOT_INFO_MEM_MAP  (1 << 6)
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+typedef struct {
+	uint32_t flags;
+	uint32_t mem_lower;     // KiB below 1 MiB
+	uint32_t mem_upper;     // KiB above 1 MiB
+	uint32_t boot_device;
+	uint32_t cmdline;
+	uint32_t mods_count;
+	uint32_t mods_addr;
+	uint32_t syms[4];
+	uint32_t mmap_length;
+	uint32_t mmap_addr;
+} __attribute__((packed)) multiboot_info_t;
+
+typedef struct {
+	uint32_t size;          // Size of the entry, not counting this field
+	uint64_t addr;
+	uint64_t len;
+	uint32_t type;
+} __attribute__((packed)) multiboot_mmap_entry_t;
+
+// Usable physical RAM, page aligned and clipped to 32-bit addresses.
+typedef struct {
+	uint32_t start;
+	uint32_t end;
+} memory_region_t;
+
+#define MEMORY_MAX_REGIONS 32
+
+// Record usable RAM from the bootloader. Must run before page_init.
+void multiboot_init(uint32_t magic, uint32_t info_phys);
+
+uint32_t memory_region_count(void);
+const memory_region_t *memory_region_get(uint32_t idx);
+uint32_t memory_total_usable(void);
+
+// True if the kernel command line contains `option` as a whole word.
+bool multiboot_cmdline_has(const char *option);
+
+// End of the usable range that contains the kernel image at 1 MiB.
+uint32_t memory_low_region_end(void);
+
+#endif
@@ -10,16 +10,26 @@
 #define PAGE_PRESENT 0x1
 #define PAGE_RW 0x2
 #define PAGE_USER 0x4
+#define PAGE_PWT 0x8
+#define PAGE_PCD 0x10
+#define PAGE_GLOBAL 0x100
 #define PAGE_COW 0x200
+#define PAGE_SHARED 0x400        // Shared memory: fork keeps it shared, not COW
 
+// User space starts at 32 MiB (where user programs are linked) and extends
+// up to the kernel's higher-half base.
 #define USER_SPACE_START 0x02000000
-#define USER_SPACE_END   0x04000000
+#define USER_SPACE_END   KERNEL_VIRT_BASE
 
 void page_init(void);
 uint32_t *page_kernel_directory(void);
 
 uint32_t *page_directory_create(void);
 void page_directory_destroy(uint32_t *page_dir);
+// Point the kernel half of page_dir at the kernel's own page tables.
+void page_directory_share_kernel(uint32_t *page_dir);
+// Mark every kernel-half mapping global (only safe without KPTI).
+void page_set_kernel_global(void);
 
 bool page_map(uint32_t *page_dir, uint32_t virt, uint32_t phys, uint32_t flags);
 bool page_map_alloc(uint32_t *page_dir, uint32_t virt, uint32_t flags, uint32_t *out_phys);
@@ -31,10 +41,17 @@ bool page_translate_flags(uint32_t *page_dir, uint32_t virt, uint32_t *out_phys,
 bool page_update_flags(uint32_t *page_dir, uint32_t virt, uint32_t set, uint32_t clear);
 bool page_copy_from_user(uint32_t *page_dir, void *dst, uint32_t src, uint32_t len);
 bool page_copy_to_user(uint32_t *page_dir, uint32_t dst, const void *src, uint32_t len);
+// Copy between two address spaces through the direct map, no bounce buffer.
+bool page_copy_user_to_user(uint32_t *dst_dir, uint32_t dst,
+                            uint32_t *src_dir, uint32_t src, uint32_t len);
 bool page_memset_user(uint32_t *page_dir, uint32_t dst, int value, uint32_t len);
 
 uint32_t frame_alloc(void);
+// Physically contiguous run of `count` frames, aligned to the next power of
+// two pages (for DMA buffers). Frames may be freed individually or together.
+uint32_t frame_alloc_contiguous(uint32_t count);
 void frame_free(uint32_t phys);
+void frame_free_contiguous(uint32_t phys, uint32_t count);
 void frame_ref_inc(uint32_t phys);
 
 #endif
@@ -4,38 +4,84 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include <kernel/ktimer.h>
+#include <kernel/wait.h>
 #include <kernel/usermode.h>
 #include <kernel/trap_frame.h>
 
 // User processes run in ring 3 and are scheduled independently of kernel tasks.
+// A thread (process_thread_create) is a process of its own, with a pid,
+// kernel stack, trap frame and FPU state, that shares the address space,
+// descriptor table and cwd of its group leader.
 
-#define PROCESS_MAX_FDS 16
+// Descriptor tables start with PROCESS_FD_INITIAL slots and double on
+// demand up to PROCESS_FD_LIMIT.
+#define PROCESS_FD_INITIAL 16
+#define PROCESS_FD_LIMIT 256
 #define PROCESS_FD_PATH_MAX 128
 #define PROCESS_NAME_MAX 32
 #define PROCESS_KERNEL_STACK_SIZE 4096
-#define PROCESS_PRIORITY_LEVELS 3
+// Multi-level feedback queue: level 0 runs first and gets the shortest
+// quantum (PROCESS_TIME_QUANTUM ticks, doubling per level). Using up a
+// quantum drops a process one level; waking on input or a pipe raises it
+// one. Every PROCESS_BOOST_TICKS, processes that sank below the top level
+// their nice value allows are lifted back to it.
+#define PROCESS_PRIORITY_LEVELS 4
 #define PROCESS_PRIORITY_DEFAULT 1
-#define PROCESS_TIME_QUANTUM 5
+#define PROCESS_TIME_QUANTUM 2
+#define PROCESS_BOOST_TICKS 100
+#define PROCESS_NICE_MIN (-20)
+#define PROCESS_NICE_MAX 19
 #define PROCESS_DEFAULT_UID 1000
 #define PROCESS_DEFAULT_GID 1000
 
+// Pipe rings start at one page and grow on demand up to a per-pipe limit
+// (PIPE_DEFAULT_SIZE unless changed with pipe_set_size).
+#define PIPE_MIN_SIZE     4096
+#define PIPE_DEFAULT_SIZE 16384
+#define PIPE_MAX_SIZE     65536
+
+// poll(): most descriptors one call may wait on, and the event bits.
+#define PROCESS_POLL_MAX 16
+#define POLLIN   0x0001
+#define POLLOUT  0x0004
+#define POLLERR  0x0008
+#define POLLHUP  0x0010
+#define POLLNVAL 0x0020
+
 typedef struct pipe pipe_t;
+struct shm_object;
+struct fpu_state;
 
 typedef enum {
 	PROCESS_FD_NONE = 0,
 	PROCESS_FD_FILE,
 	PROCESS_FD_PIPE_READ,
 	PROCESS_FD_PIPE_WRITE,
-	PROCESS_FD_TTY
+	PROCESS_FD_TTY,
+	PROCESS_FD_MOUSE,               // /dev/mouse: reads return a mouse_state_t
+	PROCESS_FD_KEYBOARD,            // /dev/keyboard: reads return queued keys
+	PROCESS_FD_INPUT,               // /dev/input: reads return input_event_t
+	PROCESS_FD_SHM                  // Shared memory object, see shm_open
 } process_fd_type_t;
 
-typedef struct {
-	bool used;
+// An open file. Descriptors point at these; dup2 and fork share them (and
+// with them the offset) rather than copying.
+typedef struct process_file {
+	uint32_t refs;                  // Descriptors, in any process, pointing here
 	uint8_t type;
-	char path[PROCESS_FD_PATH_MAX];
 	uint32_t offset;
+	char *path;                     // PROCESS_FD_FILE only
 	pipe_t *pipe;
-} process_fd_t;
+	struct shm_object *shm;
+} process_file_t;
+
+// User layout of struct pollfd.
+typedef struct {
+	int32_t fd;
+	int16_t events;
+	int16_t revents;
+} process_pollfd_t;
 
 typedef enum {
 	PROCESS_READY = 0,
@@ -52,8 +98,10 @@ typedef struct process {
 	uint32_t user_stack_top;
 	uint32_t heap_base;
 	uint32_t heap_end;
+	uint32_t surface_size;          // Bytes mapped at USER_SURFACE_BASE
 	void *kernel_stack_base;
 	uint32_t kernel_stack_top;
+	uint32_t user_cr3;              // CR3 for user mode, 0 until mapped
 	uint16_t uid;
 	uint16_t gid;
 	char cwd[USERMODE_MAX_PATH];
@@ -61,31 +109,38 @@ typedef struct process {
 	uint32_t args_len;
 	int exit_code;
 	process_state_t state;
-	uint8_t priority;
-	uint32_t time_slice;
+	uint8_t priority;               // Current MLFQ level
+	int8_t nice;
+	uint32_t time_slice;            // Ticks left at this level
 	uint32_t total_time;
 	bool reschedule;
 	trap_frame_t frame;
-	process_fd_t fds[PROCESS_MAX_FDS];
+	struct fpu_state *fpu;          // FPU/SSE save area, NULL until first use
+	process_file_t **fds;           // fd_size slots, NULL where closed
+	uint32_t fd_size;
+	uint32_t fd_open[PROCESS_FD_LIMIT / 32];   // Bitmap of open slots
 	struct process *next;
 	struct process *all_next;
-	bool waiting;
-	int32_t wait_pid;
-	uint32_t wait_status_ptr;
-	bool sleeping;
-	uint32_t sleep_until;
-	pipe_t *pipe_wait;
-	uint8_t pipe_wait_op;
-	uint32_t pipe_wait_buf;
-	uint32_t pipe_wait_len;
-	uint32_t pipe_wait_done;
+	wait_entry_t wait;              // On a wait queue while blocked in a syscall
+	void *wait_obj;                 // What the blocked call is on (pipe)
+	uint32_t wait_buf;              // User buffer (or status pointer) of the call
+	uint32_t wait_len;
+	uint32_t wait_done;
+	int32_t wait_pid;               // waitpid target, -1 for any process
+	ktimer_t sleep_timer;
+	wait_entry_t poll_entries[PROCESS_POLL_MAX];
+	uint32_t poll_count;            // poll_entries queued while in poll()
+	struct process *leader;         // Thread group leader, NULL for the leader
+	uint32_t threads;               // Leader: other threads in the group
+	uint32_t clear_tid;             // User word zeroed and futex-woken on thread exit
 } process_t;
 
 typedef struct {
 	uint32_t pid;
 	uint8_t state;
 	uint8_t priority;
-	uint16_t reserved;
+	int8_t nice;
+	uint8_t reserved;
 	uint32_t time_slice;
 	uint32_t total_time;
 	char name[PROCESS_NAME_MAX];
@@ -116,26 +171,77 @@ bool process_schedule(trap_frame_t *frame);
 bool process_exit_current(trap_frame_t *frame, int code);
 bool process_wait(trap_frame_t *frame, int32_t pid, uint32_t status_ptr,
                   int *out_pid, int *out_status);
-bool process_sleep_until(trap_frame_t *frame, uint32_t wake_tick);
+bool process_sleep_until(trap_frame_t *frame, uint32_t wake_ms);
 void process_tick(uint32_t now_ticks);
+// Raise a process that just received user input (interactivity boost).
+void process_boost(process_t *proc);
+// Add `increment` to the nice value of `pid` (0 for the caller), clamped to
+// PROCESS_NICE_MIN..PROCESS_NICE_MAX. Returns false if there is no such pid.
+bool process_renice(uint32_t pid, int increment, int *out_nice);
 void process_activate_kernel(void);
 process_t *process_next_ready(void);
 bool process_scheduler_is_active(void);
 void process_scheduler_start(void);
 void process_scheduler_stop(void);
 bool process_brk(process_t *proc, uint32_t new_end, uint32_t *out_end);
+bool process_map_surface(process_t *proc, uint32_t size);
 process_t *process_spawn_proc(const char *path, const char *args, uint32_t args_len);
 bool process_pipe_read(trap_frame_t *frame, process_t *proc, pipe_t *pipe,
                        uint32_t user_buf, uint32_t len, int *out_read);
 bool process_pipe_write(trap_frame_t *frame, process_t *proc, pipe_t *pipe,
                         uint32_t user_buf, uint32_t len, int *out_written);
+// Canonical read from the terminal and raw single-key read. Like the pipe
+// calls, these return false when the caller blocked and frame now holds
+// the next process.
+bool process_tty_read(trap_frame_t *frame, process_t *proc, uint32_t user_buf,
+                      uint32_t len, int *out_read);
+bool process_tty_getchar(trap_frame_t *frame, process_t *proc, int *out_char);
+// Wait until one of `nfds` user pollfds is ready or `timeout_ms` passes
+// (-1 waits forever, 0 only checks). Same return convention as above;
+// *out_ready is the number of ready descriptors, 0 on timeout.
+bool process_poll(trap_frame_t *frame, process_t *proc, uint32_t user_fds,
+                  uint32_t nfds, int32_t timeout_ms, int *out_ready);
 pipe_t *pipe_create(void);
 void pipe_retain_read(pipe_t *pipe);
 void pipe_retain_write(pipe_t *pipe);
 void pipe_release_read(pipe_t *pipe);
 void pipe_release_write(pipe_t *pipe);
+// Set the growth limit (rounded up to a power of two); 0 queries it.
+// Returns the limit, or 0 if it is too large or below the queued bytes.
+uint32_t pipe_set_size(pipe_t *pipe, uint32_t size);
+// The open file behind `fd`, or NULL if it is not open.
+process_file_t *process_fd_get(process_t *proc, int fd);
+// Lowest free descriptor, growing the table if it is full; -1 at the limit.
+// The slot is not reserved.
+int process_fd_alloc(process_t *proc);
+// Open a new file of `type` (path only for PROCESS_FD_FILE) on the lowest
+// free descriptor. Returns it, or -1.
+int process_fd_open(process_t *proc, uint8_t type, const char *path);
 void process_fd_close(process_t *proc, int fd);
+// Make `newfd` refer to the same open file as `oldfd`.
+bool process_fd_dup2(process_t *proc, int oldfd, int newfd);
+// Install a new open file on `fd`, closing what was there. A pipe nobody
+// holds is freed on failure.
 bool process_fd_set_pipe(process_t *proc, int fd, pipe_t *pipe, bool writable);
+// Install a shared memory object, taking over the caller's reference.
+bool process_fd_set_shm(process_t *proc, int fd, struct shm_object *obj);
 bool process_kill_other(uint32_t pid, int exit_code);
 
+// The process owning the address space and descriptors `proc` uses.
+process_t *process_group_leader(process_t *proc);
+// Start a thread in the caller's group at `entry` with the user stack
+// pointer `stack_top`. Returns its pid, or -1.
+int process_thread_create(process_t *proc, uint32_t entry, uint32_t stack_top,
+                          uint32_t clear_tid);
+// End the calling thread; in the group leader this exits the process.
+// Same return convention as process_exit_current.
+bool process_thread_exit(trap_frame_t *frame, int code);
+// Sleep until woken at `addr` if the word there still holds `expected`
+// (-1 if not), or until `timeout_ms` passes (-1 waits forever). Same
+// return convention as process_poll; *out_result is 0 once woken.
+bool process_futex_wait(trap_frame_t *frame, process_t *proc, uint32_t addr,
+                        uint32_t expected, int32_t timeout_ms, int *out_result);
+// Wake up to `count` waiters at `addr`. Returns the number woken, or -1.
+int process_futex_wake(process_t *proc, uint32_t addr, uint32_t count);
+
 #endif
@@ -0,0 +1,40 @@
+#ifndef _KERNEL_SHM_H
+#define _KERNEL_SHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Shared memory objects. An object is a set of frames that any number of
+// processes can map at USER_SHM_BASE..; each mapping holds its own frame
+// references (frame_ref_inc), so pages stay valid until the last mapping
+// is gone even after the object itself is freed. Objects are reached
+// through file descriptors (PROCESS_FD_SHM) and optionally a name; an
+// object lives while it has a descriptor or is still named.
+
+#define SHM_NAME_MAX 32
+#define SHM_MAX_SIZE (4 * 1024 * 1024)
+
+// shm_open flags
+#define SHM_CREATE 0x1              // Create the object if the name is free
+#define SHM_EXCL   0x2              // With SHM_CREATE: fail if it exists
+
+// shm_map flags
+#define SHM_MAP_WRITE 0x1
+
+typedef struct shm_object shm_object_t;
+struct process;
+
+// Find or create an object. An empty name creates an anonymous object
+// (shared by passing the descriptor to children). Returns it retained.
+shm_object_t *shm_open(const char *name, uint32_t size, uint32_t flags);
+bool shm_unlink(const char *name);
+void shm_retain(shm_object_t *obj);
+void shm_release(shm_object_t *obj);
+uint32_t shm_size(const shm_object_t *obj);
+
+// Map the whole object into `proc`. Returns the user address, 0 on failure.
+uint32_t shm_map(struct process *proc, shm_object_t *obj, uint32_t flags);
+// Unmap the shared pages in [addr, addr + size).
+bool shm_unmap(struct process *proc, uint32_t addr, uint32_t size);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _KERNEL_SLAB_H
+#define _KERNEL_SLAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Object caches for fixed-size kernel objects, layered on top of kmalloc.
+// Each cache carves kmalloc'd slabs into equally sized slots and keeps them
+// on a free list, so allocation and free are O(1) and same-typed objects
+// stay packed together instead of fragmenting the general heap.
+
+#define KMEM_CACHE_NAME_MAX 24
+
+typedef struct kmem_cache kmem_cache_t;
+
+typedef struct {
+	char name[KMEM_CACHE_NAME_MAX];
+	size_t object_size;
+	size_t objects_per_slab;
+	size_t slabs;
+	size_t active_objects;
+	size_t total_objects;
+} kmem_cache_stats_t;
+
+// Create a cache of objects of the given size. The constructor, if any, runs
+// once per object when a new slab is populated; objects must be returned to
+// the cache in their constructed state.
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+                                void (*ctor)(void *));
+
+// Release a cache and all of its slabs. Outstanding objects become invalid.
+void kmem_cache_destroy(kmem_cache_t *cache);
+
+// Allocate one object from the cache (NULL if out of memory).
+void *kmem_cache_alloc(kmem_cache_t *cache);
+
+// Return an object to the cache it was allocated from.
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+// Release fully free slabs back to kmalloc.
+void kmem_cache_shrink(kmem_cache_t *cache);
+
+// Statistics
+void kmem_cache_get_stats(kmem_cache_t *cache, kmem_cache_stats_t *stats);
+void kmem_cache_print_stats(void);
+
+#endif /* _KERNEL_SLAB_H */
@@ -83,16 +83,38 @@
 #define SYSCALL_AUDIO_SET_VOLUME 76
 #define SYSCALL_AUDIO_GET_VOLUME 77
 #define SYSCALL_AUDIO_STATUS 78
+#define SYSCALL_FAST_ENTRY 79
+#define SYSCALL_GFX_SUBMIT 80
+#define SYSCALL_GFX_MAP_SURFACE 81
+#define SYSCALL_GFX_PRESENT 82
+#define SYSCALL_CLOCK_GETTIME 83
+#define SYSCALL_NICE 84
+#define SYSCALL_PIPE_SIZE 85
+#define SYSCALL_POLL 86
+#define SYSCALL_SHM_OPEN 87
+#define SYSCALL_SHM_MAP 88
+#define SYSCALL_SHM_UNMAP 89
+#define SYSCALL_SHM_UNLINK 90
+#define SYSCALL_THREAD_CREATE 91
+#define SYSCALL_THREAD_EXIT 92
+#define SYSCALL_FUTEX_WAIT 93
+#define SYSCALL_FUTEX_WAKE 94
 
 typedef trap_frame_t syscall_frame_t;
 
 void syscall_dispatch(syscall_frame_t *frame);
+uint32_t syscall_sysexit_ok(const syscall_frame_t *frame);
 void syscall_reset_exit(void);
 uint32_t syscall_exit_status(void);
 
 // Used by assembly stubs.
 extern volatile uint32_t syscall_exit_requested;
 extern volatile uint32_t syscall_exit_code;
+// Set by sysenter_stub; cleared whenever the syscall frame is replaced.
+extern volatile uint32_t syscall_sysenter_frame;
+// Set when the #DB handler cleared a user TF that SYSENTER carried into the
+// kernel; sysenter_stub puts it back into the saved EFLAGS.
+extern volatile uint32_t syscall_sysenter_tf;
 extern volatile uint32_t usermode_return_esp;
 extern volatile uint32_t usermode_saved_ebx;
 extern volatile uint32_t usermode_saved_esi;
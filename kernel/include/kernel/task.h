@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <kernel/ktimer.h>
 
 #define MAX_TASKS 64
 #define TASK_KERNEL_STACK_SIZE 8192
@@ -39,8 +40,9 @@ typedef struct task {
     uint32_t priority;              // Task priority (0 = highest)
     uint32_t time_slice;            // Remaining time slice in ticks
     uint32_t total_time;            // Total CPU time used
-    uint32_t sleep_until;           // Tick when sleep ends (if sleeping)
+    uint32_t sleep_until;           // Time (ms) when sleep ends (if sleeping)
     bool sleeping;                  // Sleep flag for blocked tasks
+    ktimer_t sleep_timer;           // Wakes the task at sleep_until
     struct task *next;              // Next task in queue
 } task_t;
 
@@ -82,5 +84,9 @@ bool task_kill(uint32_t id);
 
 // Sleep for specified ticks
 void task_sleep(uint32_t ticks);
+void task_sleep_ms(uint32_t ms);
+
+// True if a kernel task is waiting for the CPU
+bool task_ready_any(void);
 
 #endif
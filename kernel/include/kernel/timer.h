@@ -4,12 +4,41 @@
 #include <stdint.h>
 #include <kernel/trap_frame.h>
 
+// Scheduler tick rate (timer_get_ticks); user programs assume 100 Hz.
+#define TIMER_FREQUENCY 100
+#define TIMER_TICK_MS   (1000 / TIMER_FREQUENCY)
+
+// Read-only page the kernel maps into every process at USER_VCLOCK_BASE, so
+// the monotonic clock can be read without a syscall:
+//   ns = (rdtsc() - tsc_base) * tsc_mult >> tsc_shift
+// tsc_mult is 0 when there is no usable TSC; use SYSCALL_CLOCK_GETTIME then.
+typedef struct {
+	uint32_t tsc_mult;
+	uint32_t tsc_shift;
+	uint64_t tsc_base;
+} timer_vclock_t;
+
 // Initialize the timer
 void timer_init(uint32_t frequency);
 
+// Start timer interrupts once the PIC is configured
+void timer_enable(void);
+
 // Get current tick count
 uint32_t timer_get_ticks(void);
 
+// Milliseconds since boot (the ktimer time base)
+uint32_t timer_get_ms(void);
+
+// Nanoseconds since boot from the TSC, or the tick clock without one
+uint64_t timer_get_ns(void);
+
+// Physical frame holding the timer_vclock_t page (0 if none)
+uint32_t timer_vclock_frame(void);
+
+// Halt until the next interrupt, without scheduler ticks if possible
+void timer_idle(void);
+
 // Sleep for specified milliseconds
 void timer_sleep_ms(uint32_t ms);
 
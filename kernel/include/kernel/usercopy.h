@@ -0,0 +1,22 @@
+#ifndef _KERNEL_USERCOPY_H
+#define _KERNEL_USERCOPY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Copy between kernel buffers and the current process's address space.
+// Each call validates the user range as it copies: a bad pointer makes the
+// call fail instead of faulting the kernel.
+bool copy_from_user(void *dst, uint32_t src, uint32_t len);
+bool copy_to_user(uint32_t dst, const void *src, uint32_t len);
+
+// Copy a NUL-terminated user string. Fails if the string does not fit in
+// `size` bytes including the terminator; dst is left empty on failure.
+bool strncpy_from_user(char *dst, uint32_t src, size_t size);
+
+// Page fault recovery for the raw user access routines. Returns true and
+// sets *fixup_eip if the faulting instruction has an exception table entry.
+bool usercopy_fixup(uint32_t eip, uint32_t *fixup_eip);
+
+#endif
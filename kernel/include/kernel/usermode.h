@@ -5,7 +5,17 @@
 #include <stdbool.h>
 
 #define USER_STACK_SIZE 0x10000
-#define USER_STACK_TOP  0x04000000
+#define USER_STACK_TOP  0xC0000000  // USER_SPACE_END
+// Per-process drawing surface, just below the stack's guard page.
+#define USER_SURFACE_SIZE 0x00020000
+#define USER_SURFACE_BASE (USER_STACK_TOP - USER_STACK_SIZE - USER_SURFACE_SIZE)
+// Read-only clock page (timer_vclock_t) below the surface, and below that
+// the range shm_map places shared memory in. The heap and the ELF image
+// end below both.
+#define USER_VCLOCK_BASE (USER_SURFACE_BASE - 0x1000)
+#define USER_SHM_SIZE 0x01000000
+#define USER_SHM_BASE (USER_VCLOCK_BASE - USER_SHM_SIZE)
+#define USER_HEAP_LIMIT USER_SHM_BASE
 #define USERMODE_MAX_PATH 128
 #define USERMODE_MAX_ARGS 128
 
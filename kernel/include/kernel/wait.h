@@ -0,0 +1,107 @@
+#ifndef _KERNEL_WAIT_H
+#define _KERNEL_WAIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <kernel/cpu.h>
+
+// FIFO wait queues. Each waiter carries a wake callback, so waking costs
+// only the entries woken, never a scan of every process or task.
+//
+// Kernel tasks sleep in wait_event and their entry just unblocks them. A
+// user process blocked in a system call has no kernel stack to return to,
+// so its callback finishes the call itself (copies data, sets eax, makes
+// the process runnable) and returns false if it cannot finish yet, which
+// leaves the entry queued in its place.
+
+typedef struct wait_entry wait_entry_t;
+typedef struct wait_queue wait_queue_t;
+// `key` is whatever the waker passed to wake_up (NULL for one/all).
+typedef bool (*wait_fn_t)(wait_entry_t *entry, void *key);
+
+struct wait_entry {
+	wait_entry_t *next;
+	wait_entry_t *prev;
+	wait_queue_t *queue;    // NULL when not queued
+	wait_fn_t fn;
+	void *data;
+};
+
+struct wait_queue {
+	wait_entry_t *head;
+	wait_entry_t *tail;
+};
+
+void wait_queue_init(wait_queue_t *queue);
+void wait_entry_init(wait_entry_t *entry, wait_fn_t fn, void *data);
+void wait_queue_add(wait_queue_t *queue, wait_entry_t *entry);
+// Safe on an entry that is not queued.
+void wait_queue_remove(wait_entry_t *entry);
+bool wait_queue_empty(const wait_queue_t *queue);
+
+// Run callbacks from the head until `max` of them return true; those
+// entries leave the queue. Returns the number woken.
+uint32_t wake_up(wait_queue_t *queue, uint32_t max, void *key);
+
+static inline bool wake_up_one(wait_queue_t *queue) {
+	return wake_up(queue, 1, NULL) != 0;
+}
+
+static inline uint32_t wake_up_all(wait_queue_t *queue) {
+	return wake_up(queue, UINT32_MAX, NULL);
+}
+
+static inline uint32_t wait_irq_save(void) {
+	uint32_t flags = read_eflags();
+	cpu_cli();
+	return flags;
+}
+
+static inline void wait_irq_restore(uint32_t flags) {
+	if (flags & EFLAGS_IF) {
+		cpu_sti();
+	}
+}
+
+// Sleep the current kernel task on `queue` once. Called with interrupts
+// disabled by wait_irq_save, and returns with them disabled. Without
+// another task to run it halts with interrupts enabled until the next one
+// arrives, even if the caller had them off, since only an interrupt can
+// make the condition true.
+void wait_sleep(wait_queue_t *queue);
+
+// Block the current kernel task until `condition` holds. The condition is
+// checked with interrupts disabled, so a wakeup cannot slip in between.
+#define wait_event(queue, condition)                \
+	do {                                            \
+		uint32_t wait_flags_ = wait_irq_save();     \
+		while (!(condition)) {                      \
+			wait_sleep((queue));                    \
+		}                                           \
+		wait_irq_restore(wait_flags_);              \
+	} while (0)
+
+// Sleeping locks for kernel tasks; never take them from an interrupt.
+typedef struct {
+	bool locked;
+	wait_queue_t waiters;
+} mutex_t;
+
+void mutex_init(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+bool mutex_trylock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+typedef struct {
+	uint32_t count;
+	wait_queue_t waiters;
+} semaphore_t;
+
+void semaphore_init(semaphore_t *sem, uint32_t count);
+void semaphore_down(semaphore_t *sem);
+bool semaphore_trydown(semaphore_t *sem);
+// Safe from interrupt handlers.
+void semaphore_up(semaphore_t *sem);
+
+#endif
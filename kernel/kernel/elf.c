@@ -96,6 +96,11 @@ bool elf_load_file(const char *path, elf_image_t *image, uint32_t *page_dir) {
 			kfree(file);
 			return false;
 		}
+		if (ph->vaddr + ph->memsz < ph->vaddr || ph->vaddr + ph->memsz > USER_SPACE_END) {
+			printf("ELF: segment above user range (0x%x)\n", ph->vaddr);
+			kfree(file);
+			return false;
+		}
 
 		uint32_t seg_flags = PAGE_USER | PAGE_RW;
 
@@ -0,0 +1,90 @@
+#include <kernel/input.h>
+#include <kernel/cpu.h>
+#include <kernel/timer.h>
+
+#define INPUT_QUEUE_MASK (INPUT_QUEUE_SIZE - 1)
+
+// Filled from IRQ handlers, drained from system calls with interrupts off.
+static input_event_t queue[INPUT_QUEUE_SIZE];
+static volatile uint32_t queue_head = 0;    // Next slot to write
+static volatile uint32_t queue_tail = 0;    // Next slot to read
+static uint32_t open_count = 0;
+
+static inline uint32_t input_lock(void) {
+	uint32_t flags = read_eflags();
+	cpu_cli();
+	return flags;
+}
+
+static inline void input_unlock(uint32_t flags) {
+	if (flags & EFLAGS_IF) {
+		cpu_sti();
+	}
+}
+
+static void input_push(uint16_t type, uint16_t code, int32_t value) {
+	input_event_t *event = &queue[queue_head & INPUT_QUEUE_MASK];
+	event->time_ns = timer_get_ns();
+	event->type = type;
+	event->code = code;
+	event->value = value;
+	queue_head++;
+}
+
+void input_report(uint16_t type, uint16_t code, int32_t value) {
+	if (!open_count) {
+		return;
+	}
+	uint32_t flags = input_lock();
+	if (queue_head - queue_tail >= INPUT_QUEUE_SIZE - 1) {
+		// Like evdev: throw the backlog away and tell the reader, who has
+		// to assume any button may have changed.
+		queue_tail = queue_head;
+		input_push(INPUT_EV_SYN, INPUT_SYN_DROPPED, 0);
+	}
+	input_push(type, code, value);
+	input_unlock(flags);
+}
+
+void input_sync(void) {
+	input_report(INPUT_EV_SYN, INPUT_SYN_REPORT, 0);
+}
+
+bool input_grabbed(void) {
+	return open_count > 0;
+}
+
+void input_open(void) {
+	uint32_t flags = input_lock();
+	if (open_count++ == 0) {
+		queue_head = 0;
+		queue_tail = 0;
+	}
+	input_unlock(flags);
+}
+
+void input_close(void) {
+	uint32_t flags = input_lock();
+	if (open_count > 0 && --open_count == 0) {
+		queue_tail = queue_head;
+	}
+	input_unlock(flags);
+}
+
+bool input_has_events(void) {
+	return queue_head != queue_tail;
+}
+
+uint32_t input_read(input_event_t *out, uint32_t max) {
+	if (!out) {
+		return 0;
+	}
+	uint32_t flags = input_lock();
+	uint32_t count = 0;
+	while (count < max && queue_tail != queue_head) {
+		out[count++] = queue[queue_tail & INPUT_QUEUE_MASK];
+		queue_tail++;
+	}
+	input_unlock(flags);
+	return count;
+}
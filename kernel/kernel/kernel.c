@@ -14,7 +14,9 @@
 #include <kernel/ata.h>
 #include <kernel/fs.h>
 #include <kernel/kmalloc.h>
+#include <kernel/multiboot.h>
 #include <kernel/cpu.h>
+#include <kernel/fpu.h>
 #include <kernel/gdt.h>
 #include <kernel/kpti.h>
 #include <kernel/user_programs.h>
@@ -534,14 +536,16 @@ static void boot_dma_toggle_prompt(void) {
     }
 }
 
-void kernel_main(void) {   
+void kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
 	__asm__ volatile ("cli"); // Keep interrupts off until IDT is installed.
 
 	terminal_initialize();
+	multiboot_init(multiboot_magic, multiboot_info);
     
 	gdt_init();
     page_init();
 	kpti_init();
+	sysenter_init();
 	write_cr0(read_cr0() | CR0_WP);
 
 	// Initialize kernel heap after paging is ready
@@ -549,6 +553,7 @@ void kernel_main(void) {
 	process_init();
     
 	idt_init();
+	fpu_init();
     timer_init(100); // Initialize timer at 100 Hz (10ms per tick)
     task_scheduler_init(); // Initialize kernel task scheduler
     keyboard_init();
@@ -557,7 +562,7 @@ void kernel_main(void) {
 	idt_init();
 	pic_disable();
 	__asm__ volatile ("sti");
-	IRQ_clear_mask(0);  // Timer
+	timer_enable();
 	IRQ_clear_mask(1);  // Keyboard
 	IRQ_clear_mask(2);  // Cascade (needed for IRQ12)
 	IRQ_clear_mask(12); // Mouse
@@ -616,7 +621,7 @@ void kernel_main(void) {
     
 
     while(1) {
-        __asm__ volatile ("hlt");
+        timer_idle();
     }
 }
     
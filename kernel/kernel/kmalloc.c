@@ -3,12 +3,38 @@
 #include <stdio.h>
 #include <string.h>
 
-// Bitmap allocator implementation
-// Each bit represents one HEAP_BLOCK_SIZE block
-static uint32_t heap_bitmap[HEAP_BLOCKS / 32];
+// Segregated-fit allocator over HEAP_BLOCK_SIZE blocks.
+// Free runs are kept on size-class lists indexed by a two-level
+// (power of two, then 16 linear steps) class; fl_bitmap/sl_bitmap mark the
+// non-empty lists so a fitting run is found with two __builtin_ctz calls.
+// Adjacent free runs are merged on free using boundary tags.
+#define SL_INDEX_LOG2 4
+#define SL_INDEX_COUNT (1 << SL_INDEX_LOG2)
+#define FL_INDEX_MAX 24                                   // Runs up to 2^24 blocks
+#define FL_INDEX_COUNT (FL_INDEX_MAX - SL_INDEX_LOG2 + 2)
+
+// Header stored in the first block of every free run
+typedef struct free_run {
+    uint32_t size;              // Run length in blocks
+    uint32_t magic;
+    struct free_run* next;
+    struct free_run* prev;
+} free_run_t;
+
+#define FREE_MAGIC 0xFEEDFACE
+
+static free_run_t* free_lists[FL_INDEX_COUNT][SL_INDEX_COUNT];
+static uint32_t fl_bitmap;
+static uint32_t sl_bitmap[FL_INDEX_COUNT];
+// One bit per block: set iff the block is the first block of a free run.
+// Lives in the first blocks of the heap itself, since the heap is sized at boot.
+static uint32_t* heap_free_map;
 static bool heap_initialized = false;
 static heap_stats_t heap_stats;
 
+uint32_t kernel_heap_phys_start = 0x00400000;
+uint32_t kernel_heap_size = 0x01000000;
+
 // Allocation header stored before each allocated block
 typedef struct {
     size_t size;        // Size of allocation in blocks
@@ -19,72 +45,187 @@ typedef struct {
 #define HEADER_BLOCKS ((sizeof(alloc_header_t) + HEAP_BLOCK_SIZE - 1) / HEAP_BLOCK_SIZE)
 
 // Helper functions
-static inline void bitmap_set(uint32_t bit) {
-    heap_bitmap[bit / 32] |= (1 << (bit % 32));
+static inline void free_map_set(uint32_t block) {
+    heap_free_map[block / 32] |= (1u << (block % 32));
 }
 
-static inline void bitmap_clear(uint32_t bit) {
-    heap_bitmap[bit / 32] &= ~(1 << (bit % 32));
+static inline void free_map_clear(uint32_t block) {
+    heap_free_map[block / 32] &= ~(1u << (block % 32));
 }
 
-static inline bool bitmap_test(uint32_t bit) {
-    return (heap_bitmap[bit / 32] & (1 << (bit % 32))) != 0;
+static inline bool free_map_test(uint32_t block) {
+    return (heap_free_map[block / 32] & (1u << (block % 32))) != 0;
 }
 
-// Find a contiguous run of free blocks
-static int find_free_blocks(size_t num_blocks) {
-    size_t count = 0;
-    int start = -1;
-    
-    for (size_t i = 0; i < HEAP_BLOCKS; i++) {
-        if (!bitmap_test(i)) {
-            if (count == 0) {
-                start = i;
-            }
-            count++;
-            if (count >= num_blocks) {
-                return start;
-            }
-        } else {
-            count = 0;
-            start = -1;
+static inline free_run_t* run_ptr(uint32_t block) {
+    return (free_run_t*)(HEAP_START + block * HEAP_BLOCK_SIZE);
+}
+
+static inline uint32_t run_index(free_run_t* run) {
+    return ((uintptr_t)run - HEAP_START) / HEAP_BLOCK_SIZE;
+}
+
+// Footer in the last word of a free run's last block: index of its first block
+static inline uint32_t* run_footer(uint32_t block, uint32_t size) {
+    return (uint32_t*)(HEAP_START + (block + size) * HEAP_BLOCK_SIZE) - 1;
+}
+
+static inline uint32_t fls32(uint32_t value) {
+    return 31 - __builtin_clz(value);
+}
+
+static void mapping_insert(uint32_t size, uint32_t* fl, uint32_t* sl) {
+    if (size < SL_INDEX_COUNT) {
+        *fl = 0;
+        *sl = size;
+    } else {
+        uint32_t msb = fls32(size);
+        *sl = (size >> (msb - SL_INDEX_LOG2)) ^ SL_INDEX_COUNT;
+        *fl = msb - SL_INDEX_LOG2 + 1;
+    }
+}
+
+// Class whose every run is at least `size` blocks (rounds the request up)
+static void mapping_search(uint32_t size, uint32_t* fl, uint32_t* sl) {
+    if (size >= SL_INDEX_COUNT) {
+        size += (1u << (fls32(size) - SL_INDEX_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static void recompute_largest_free_block(void) {
+    if (fl_bitmap == 0) {
+        heap_stats.largest_free_block = 0;
+        return;
+    }
+    // Only the highest non-empty class can hold the largest run
+    uint32_t fl = fls32(fl_bitmap);
+    uint32_t sl = fls32(sl_bitmap[fl]);
+    uint32_t largest = 0;
+    for (free_run_t* run = free_lists[fl][sl]; run; run = run->next) {
+        if (run->size > largest) {
+            largest = run->size;
         }
     }
-    
-    return -1; // Not found
+    heap_stats.largest_free_block = largest * HEAP_BLOCK_SIZE;
+}
+
+static void free_run_insert(uint32_t block, uint32_t size) {
+    free_run_t* run = run_ptr(block);
+    uint32_t fl, sl;
+    mapping_insert(size, &fl, &sl);
+
+    run->size = size;
+    run->magic = FREE_MAGIC;
+    run->prev = NULL;
+    run->next = free_lists[fl][sl];
+    if (run->next) {
+        run->next->prev = run;
+    }
+    free_lists[fl][sl] = run;
+    fl_bitmap |= (1u << fl);
+    sl_bitmap[fl] |= (1u << sl);
+
+    *run_footer(block, size) = block;
+    free_map_set(block);
+
+    if ((size_t)size * HEAP_BLOCK_SIZE > heap_stats.largest_free_block) {
+        heap_stats.largest_free_block = (size_t)size * HEAP_BLOCK_SIZE;
+    }
+}
+
+static void free_run_remove(free_run_t* run) {
+    uint32_t fl, sl;
+    mapping_insert(run->size, &fl, &sl);
+
+    if (run->prev) {
+        run->prev->next = run->next;
+    } else {
+        free_lists[fl][sl] = run->next;
+    }
+    if (run->next) {
+        run->next->prev = run->prev;
+    }
+    if (!free_lists[fl][sl]) {
+        sl_bitmap[fl] &= ~(1u << sl);
+        if (!sl_bitmap[fl]) {
+            fl_bitmap &= ~(1u << fl);
+        }
+    }
+
+    run->magic = 0;
+    free_map_clear(run_index(run));
+
+    if ((size_t)run->size * HEAP_BLOCK_SIZE == heap_stats.largest_free_block) {
+        recompute_largest_free_block();
+    }
 }
 
-// Mark blocks as used
-static void mark_blocks_used(int start, size_t num_blocks) {
-    for (size_t i = 0; i < num_blocks; i++) {
-        bitmap_set(start + i);
+// Find and remove a free run of at least num_blocks blocks
+static free_run_t* find_free_run(uint32_t num_blocks) {
+    uint32_t fl, sl;
+    mapping_search(num_blocks, &fl, &sl);
+    if (fl >= FL_INDEX_COUNT) {
+        return NULL;
+    }
+
+    uint32_t sl_map = sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint32_t fl_map = (fl + 1 < 32) ? (fl_bitmap & (~0u << (fl + 1))) : 0;
+        if (!fl_map) {
+            return NULL;
+        }
+        fl = __builtin_ctz(fl_map);
+        sl_map = sl_bitmap[fl];
     }
+    sl = __builtin_ctz(sl_map);
+
+    free_run_t* run = free_lists[fl][sl];
+    free_run_remove(run);
+    return run;
 }
 
-// Mark blocks as free
-static void mark_blocks_free(int start, size_t num_blocks) {
-    for (size_t i = 0; i < num_blocks; i++) {
-        bitmap_clear(start + i);
+// Take a free run of exactly num_blocks blocks, or return -1
+static int alloc_blocks(size_t num_blocks) {
+    if (num_blocks > HEAP_BLOCKS) {
+        return -1;
     }
+    free_run_t* run = find_free_run(num_blocks);
+    if (!run) {
+        return -1;
+    }
+
+    uint32_t start = run_index(run);
+    uint32_t size = run->size;
+    if (size > num_blocks) {
+        free_run_insert(start + num_blocks, size - num_blocks);
+    }
+    return start;
 }
 
-// Get largest contiguous free block
-static size_t get_largest_free_block(void) {
-    size_t max_count = 0;
-    size_t count = 0;
-    
-    for (size_t i = 0; i < HEAP_BLOCKS; i++) {
-        if (!bitmap_test(i)) {
-            count++;
-            if (count > max_count) {
-                max_count = count;
-            }
-        } else {
-            count = 0;
+// Return blocks to the free lists, merging with free neighbours
+static void free_blocks(uint32_t start, size_t num_blocks) {
+    uint32_t size = num_blocks;
+
+    uint32_t next = start + size;
+    if (next < HEAP_BLOCKS && free_map_test(next)) {
+        free_run_t* right = run_ptr(next);
+        size += right->size;
+        free_run_remove(right);
+    }
+
+    if (start > 0) {
+        // The footer is only trusted if it names a free run ending right here
+        uint32_t left = *run_footer(start - 1, 1);
+        if (left < start && free_map_test(left) && run_ptr(left)->size == start - left) {
+            free_run_t* run = run_ptr(left);
+            size += run->size;
+            free_run_remove(run);
+            start = left;
         }
     }
-    
-    return max_count * HEAP_BLOCK_SIZE;
+
+    free_run_insert(start, size);
 }
 
 // Initialize the kernel heap
@@ -93,16 +234,25 @@ void kmalloc_init(void) {
         return;
     }
     
-    // Clear the bitmap
-    memset(heap_bitmap, 0, sizeof(heap_bitmap));
+    memset(free_lists, 0, sizeof(free_lists));
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    fl_bitmap = 0;
+
+    size_t map_bytes = ((HEAP_BLOCKS + 31) / 32) * sizeof(uint32_t);
+    uint32_t map_blocks = (map_bytes + HEAP_BLOCK_SIZE - 1) / HEAP_BLOCK_SIZE;
+    heap_free_map = (uint32_t*)HEAP_START;
+    memset(heap_free_map, 0, map_bytes);
     
     // Initialize statistics
     heap_stats.total_size = HEAP_SIZE;
-    heap_stats.used_size = 0;
-    heap_stats.free_size = HEAP_SIZE;
+    heap_stats.used_size = map_blocks * HEAP_BLOCK_SIZE;
+    heap_stats.free_size = HEAP_SIZE - heap_stats.used_size;
     heap_stats.num_allocations = 0;
     heap_stats.num_frees = 0;
-    heap_stats.largest_free_block = HEAP_SIZE;
+    heap_stats.largest_free_block = 0;
+    
+    // Everything after the free map starts out as a single free run
+    free_run_insert(map_blocks, HEAP_BLOCKS - map_blocks);
     
     heap_initialized = true;
     
@@ -120,15 +270,12 @@ void* kmalloc(size_t size) {
     size_t total_blocks = HEADER_BLOCKS + ((size + HEAP_BLOCK_SIZE - 1) / HEAP_BLOCK_SIZE);
     
     // Find free blocks
-    int start_block = find_free_blocks(total_blocks);
+    int start_block = alloc_blocks(total_blocks);
     if (start_block < 0) {
         printf("kmalloc: Out of memory (requested %d bytes, %d blocks)\n", size, total_blocks);
         return NULL;
     }
     
-    // Mark blocks as used
-    mark_blocks_used(start_block, total_blocks);
-    
     // Calculate address
     void* ptr = (void*)(HEAP_START + start_block * HEAP_BLOCK_SIZE);
     
@@ -191,24 +338,29 @@ void kfree(void* ptr) {
     
     // Calculate block number
     uintptr_t addr = (uintptr_t)header;
-    if (addr < HEAP_START || addr >= HEAP_START + HEAP_SIZE) {
+    if (addr < HEAP_START || addr >= HEAP_START + HEAP_SIZE ||
+        (addr - HEAP_START) % HEAP_BLOCK_SIZE != 0) {
         printf("kfree: Pointer out of heap bounds (addr=0x%x)\n", addr);
         return;
     }
     
-    int start_block = (addr - HEAP_START) / HEAP_BLOCK_SIZE;
+    uint32_t start_block = (addr - HEAP_START) / HEAP_BLOCK_SIZE;
     size_t num_blocks = header->size;
+    if (num_blocks == 0 || start_block + num_blocks > HEAP_BLOCKS) {
+        printf("kfree: Corrupted allocation size (addr=0x%x)\n", addr);
+        return;
+    }
+    
+    // Clear magic to detect double-free
+    header->magic = 0;
     
-    // Mark blocks as free
-    mark_blocks_free(start_block, num_blocks);
+    // Return blocks to the free lists
+    free_blocks(start_block, num_blocks);
     
     // Update statistics
     heap_stats.used_size -= num_blocks * HEAP_BLOCK_SIZE;
     heap_stats.free_size += num_blocks * HEAP_BLOCK_SIZE;
     heap_stats.num_frees++;
-    
-    // Clear magic to detect double-free
-    header->magic = 0;
 }
 
 // Reallocate memory (resize allocation)
@@ -256,7 +408,6 @@ void kmalloc_get_stats(heap_stats_t* stats) {
     }
     
     *stats = heap_stats;
-    stats->largest_free_block = get_largest_free_block();
 }
 
 // Print heap statistics
@@ -1,8 +1,18 @@
 #include <kernel/kpti.h>
+#include <kernel/cpu.h>
 #include <kernel/gdt.h>
 #include <kernel/interrupt.h>
+#include <kernel/multiboot.h>
 #include <kernel/pagings.h>
 #include <kernel/process.h>
+#include <stdio.h>
+#include <string.h>
+
+// Build with KPTI=0 to run without page table isolation by default; the
+// "nokpti" boot option does the same at runtime.
+#ifndef KPTI_ENABLE
+#define KPTI_ENABLE 1
+#endif
 
 typedef struct {
 	uint32_t gs, fs, es, ds;
@@ -14,10 +24,16 @@ typedef struct {
 extern uint32_t trampoline_kernel_cr3;
 extern uint32_t trampoline_return_to_user;
 extern uint32_t trampoline_user_cr3;
+extern uint32_t trampoline_kpti_enabled;
 extern char kpti_trampoline_start[];
 extern char kpti_trampoline_end[];
 
-static bool kpti_map_page(uint32_t *page_dir, uintptr_t addr) {
+static bool kpti_on = true;
+// PTE flag for pages identical in every address space (trampoline, IDT,
+// GDT, TSS): global entries survive the CR3 reloads on each kernel entry.
+static uint32_t kpti_shared_flags = 0;
+
+static bool kpti_map_page(uint32_t *page_dir, uintptr_t addr, uint32_t flags) {
 	uint32_t phys = 0;
 	if (!page_translate(page_kernel_directory(), (uint32_t)addr, &phys)) {
 		return false;
@@ -26,117 +42,140 @@ static bool kpti_map_page(uint32_t *page_dir, uintptr_t addr) {
 		return true;
 	}
 	return page_map(page_dir, (uint32_t)(addr & ~(PAGE_SIZE - 1)),
-	                phys & ~(PAGE_SIZE - 1), PAGE_RW);
+	                phys & ~(PAGE_SIZE - 1), PAGE_RW | flags);
 }
 
-static bool kpti_map_range(uint32_t *page_dir, uintptr_t start, size_t size) {
+static bool kpti_map_range(uint32_t *page_dir, uintptr_t start, size_t size, uint32_t flags) {
 	if (!page_dir || size == 0) {
 		return false;
 	}
 	uintptr_t cur = start & ~(uintptr_t)(PAGE_SIZE - 1);
 	uintptr_t end = (start + size - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
 	for (; cur <= end; cur += PAGE_SIZE) {
-		if (!kpti_map_page(page_dir, cur)) {
+		if (!kpti_map_page(page_dir, cur, flags)) {
 			return false;
 		}
 	}
 	return true;
 }
 
-static bool kpti_map_kernel_stack(uint32_t *page_dir, uint32_t esp) {
-	if (!page_dir) {
-		return false;
-	}
-	uint32_t stack_page = esp & ~(PAGE_SIZE - 1);
-	return kpti_map_page(page_dir, (uintptr_t)stack_page);
-}
-
 void kpti_init(void) {
 	uint32_t *kernel_dir = page_kernel_directory();
 	if (kernel_dir) {
 		trampoline_kernel_cr3 = virt_to_phys(kernel_dir);
 	}
+
+	kpti_on = KPTI_ENABLE && !multiboot_cmdline_has("nokpti");
+	trampoline_kpti_enabled = kpti_on ? 1 : 0;
+
+	bool global_pages = cpu_has_feature(CPUID_FEAT_EDX_PGE);
+	if (global_pages) {
+		write_cr4(read_cr4() | CR4_PGE);
+		kpti_shared_flags = PAGE_GLOBAL;
+		// Without isolation the whole kernel half is shared by every process.
+		if (!kpti_on) {
+			page_set_kernel_global();
+		}
+	}
+
+	printf("KPTI: %s, global pages %s\n",
+	       kpti_on ? "enabled" : "disabled",
+	       global_pages ? "on" : "unsupported");
+}
+
+bool kpti_enabled(void) {
+	return kpti_on;
 }
 
-void kpti_map_kernel_pages(uint32_t *page_dir, struct process *proc) {
+// Establish everything the directory needs to enter and leave the kernel,
+// including the process's kernel stack, which never moves once allocated.
+bool kpti_map_kernel_pages(uint32_t *page_dir, struct process *proc) {
 	if (!page_dir) {
-		return;
+		return false;
+	}
+	if (!kpti_on) {
+		page_directory_share_kernel(page_dir);
+		return true;
 	}
 
 	uintptr_t tramp_base = (uintptr_t)kpti_trampoline_start;
 	size_t tramp_size = (size_t)(kpti_trampoline_end - kpti_trampoline_start);
-	kpti_map_range(page_dir, tramp_base, tramp_size);
+	if (!kpti_map_range(page_dir, tramp_base, tramp_size, kpti_shared_flags)) {
+		return false;
+	}
 
 	uintptr_t idt_base = 0;
 	size_t idt_size = 0;
 	idt_get_range(&idt_base, &idt_size);
-	kpti_map_range(page_dir, idt_base, idt_size);
+	if (!kpti_map_range(page_dir, idt_base, idt_size, kpti_shared_flags)) {
+		return false;
+	}
 
 	uintptr_t gdt_base = 0;
 	size_t gdt_size = 0;
 	gdt_get_range(&gdt_base, &gdt_size);
-	kpti_map_range(page_dir, gdt_base, gdt_size);
+	if (!kpti_map_range(page_dir, gdt_base, gdt_size, kpti_shared_flags)) {
+		return false;
+	}
 
 	uintptr_t tss_base = 0;
 	size_t tss_size = 0;
 	tss_get_range(&tss_base, &tss_size);
-	kpti_map_range(page_dir, tss_base, tss_size);
+	if (!kpti_map_range(page_dir, tss_base, tss_size, kpti_shared_flags)) {
+		return false;
+	}
 
+	// Kernel stack slots are reused by later processes, so never global.
 	if (proc && proc->kernel_stack_base) {
-		kpti_map_range(page_dir, (uintptr_t)proc->kernel_stack_base,
-		               PROCESS_KERNEL_STACK_SIZE);
+		return kpti_map_range(page_dir, (uintptr_t)proc->kernel_stack_base,
+		                      PROCESS_KERNEL_STACK_SIZE, 0);
 	}
+	return true;
 }
 
-void kpti_prepare_return_trap(trap_frame_t *frame) {
-	if (!frame) {
-		return;
-	}
-	if ((frame->cs & 0x3) != 0x3) {
-		trampoline_return_to_user = 0;
-		return;
+static uint32_t kpti_prepare_return(void *frame, size_t frame_size, uint32_t cs) {
+	trampoline_return_to_user = 0;
+	if ((cs & 0x3) != 0x3) {
+		return (uint32_t)frame;
 	}
 	process_t *proc = process_current();
-	if (!proc || !proc->page_directory) {
-		trampoline_return_to_user = 0;
-		return;
-	}
-	if (!kpti_map_kernel_stack(proc->page_directory, frame->esp)) {
-		if (!proc->kernel_stack_base ||
-		    !kpti_map_range(proc->page_directory,
-		                    (uintptr_t)proc->kernel_stack_base,
-		                    PROCESS_KERNEL_STACK_SIZE)) {
-			trampoline_return_to_user = 0;
-			return;
+	if (!proc || !proc->user_cr3 || !proc->kernel_stack_base) {
+		return (uint32_t)frame;
+	}
+
+	// After a process switch the frame still sits on the previous process's
+	// kernel stack; move it to the top of the new one.
+	uint32_t esp = (uint32_t)frame;
+	uint32_t stack_base = (uint32_t)proc->kernel_stack_base;
+	if (esp < stack_base || esp + frame_size > proc->kernel_stack_top) {
+		esp = proc->kernel_stack_top - frame_size;
+		memmove((void *)esp, frame, frame_size);
+	}
+
+	if (!kpti_on) {
+		// The process directory maps the kernel too: switch now, and only
+		// if another process was scheduled, so the TLB stays warm.
+		if (read_cr3() != proc->user_cr3) {
+			write_cr3(proc->user_cr3);
 		}
+		return esp;
 	}
-	trampoline_user_cr3 = virt_to_phys(proc->page_directory);
+	trampoline_user_cr3 = proc->user_cr3;
 	trampoline_return_to_user = 1;
+	return esp;
+}
+
+uint32_t kpti_prepare_return_trap(trap_frame_t *frame) {
+	if (!frame) {
+		return 0;
+	}
+	return kpti_prepare_return(frame, sizeof(*frame), frame->cs);
 }
 
-void kpti_prepare_return_isr(void *frame) {
+uint32_t kpti_prepare_return_isr(void *frame) {
 	kpti_isr_frame_t *isr = (kpti_isr_frame_t *)frame;
 	if (!isr) {
-		return;
+		return 0;
 	}
-	if ((isr->cs & 0x3) != 0x3) {
-		trampoline_return_to_user = 0;
-		return;
-	}
-	process_t *proc = process_current();
-	if (!proc || !proc->page_directory) {
-		trampoline_return_to_user = 0;
-		return;
-	}
-	if (!kpti_map_kernel_stack(proc->page_directory, isr->esp)) {
-		if (!proc->kernel_stack_base ||
-		    !kpti_map_range(proc->page_directory,
-		                    (uintptr_t)proc->kernel_stack_base,
-		                    PROCESS_KERNEL_STACK_SIZE)) {
-			trampoline_return_to_user = 0;
-			return;
-		}
-	}
-	trampoline_user_cr3 = virt_to_phys(proc->page_directory);
-	trampoline_return_to_user = 1;
+	return kpti_prepare_return(isr, sizeof(*isr), isr->cs);
 }
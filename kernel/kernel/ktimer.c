@@ -0,0 +1,194 @@
+#include <kernel/ktimer.h>
+#include <kernel/cpu.h>
+#include <stddef.h>
+
+// The root wheel holds timers due within the next 256 ticks, one slot per
+// tick. Each outer level covers 64 times the span of the one below it; when
+// the root wraps, the next slot of level 0 is redistributed ("cascaded")
+// into the root, and so on outwards. Four outer levels cover 2^32 ticks.
+#define WHEEL_ROOT_BITS 8
+#define WHEEL_LEVEL_BITS 6
+#define WHEEL_ROOT_SIZE (1u << WHEEL_ROOT_BITS)
+#define WHEEL_LEVEL_SIZE (1u << WHEEL_LEVEL_BITS)
+#define WHEEL_ROOT_MASK (WHEEL_ROOT_SIZE - 1)
+#define WHEEL_LEVEL_MASK (WHEEL_LEVEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+
+static ktimer_t *wheel_root[WHEEL_ROOT_SIZE];
+static ktimer_t *wheel_levels[WHEEL_LEVELS][WHEEL_LEVEL_SIZE];
+// Next tick the wheel will process.
+static uint32_t wheel_tick = 0;
+
+static inline uint32_t ktimer_lock(void) {
+	uint32_t flags = read_eflags();
+	cpu_cli();
+	return flags;
+}
+
+static inline void ktimer_unlock(uint32_t flags) {
+	if (flags & EFLAGS_IF) {
+		cpu_sti();
+	}
+}
+
+static void ktimer_link(ktimer_t **head, ktimer_t *timer) {
+	timer->next = *head;
+	if (*head) {
+		(*head)->pprev = &timer->next;
+	}
+	*head = timer;
+	timer->pprev = head;
+}
+
+static void ktimer_unlink(ktimer_t *timer) {
+	*timer->pprev = timer->next;
+	if (timer->next) {
+		timer->next->pprev = timer->pprev;
+	}
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+static void wheel_insert(ktimer_t *timer) {
+	uint32_t expires = timer->expires;
+	uint32_t delta = expires - wheel_tick;
+	ktimer_t **head;
+	if ((int32_t)delta < 0) {
+		head = &wheel_root[wheel_tick & WHEEL_ROOT_MASK];
+	} else if (delta < WHEEL_ROOT_SIZE) {
+		head = &wheel_root[expires & WHEEL_ROOT_MASK];
+	} else {
+		uint32_t level = 0;
+		uint32_t shift = WHEEL_ROOT_BITS + WHEEL_LEVEL_BITS;
+		while (level < WHEEL_LEVELS - 1 && delta >= (1u << shift)) {
+			level++;
+			shift += WHEEL_LEVEL_BITS;
+		}
+		shift -= WHEEL_LEVEL_BITS;
+		head = &wheel_levels[level][(expires >> shift) & WHEEL_LEVEL_MASK];
+	}
+	ktimer_link(head, timer);
+}
+
+// Move every timer in one outer slot down to where it now belongs.
+static void wheel_cascade(uint32_t level, uint32_t idx) {
+	ktimer_t *list = wheel_levels[level][idx];
+	wheel_levels[level][idx] = NULL;
+	while (list) {
+		ktimer_t *timer = list;
+		list = timer->next;
+		timer->next = NULL;
+		timer->pprev = NULL;
+		wheel_insert(timer);
+	}
+}
+
+void ktimer_init(ktimer_t *timer, ktimer_fn_t fn, void *data) {
+	if (!timer) {
+		return;
+	}
+	timer->next = NULL;
+	timer->pprev = NULL;
+	timer->expires = 0;
+	timer->fn = fn;
+	timer->data = data;
+}
+
+void ktimer_add(ktimer_t *timer, uint32_t expires) {
+	if (!timer || !timer->fn) {
+		return;
+	}
+	uint32_t flags = ktimer_lock();
+	if (timer->pprev) {
+		ktimer_unlink(timer);
+	}
+	timer->expires = expires;
+	wheel_insert(timer);
+	ktimer_unlock(flags);
+}
+
+bool ktimer_cancel(ktimer_t *timer) {
+	if (!timer) {
+		return false;
+	}
+	uint32_t flags = ktimer_lock();
+	bool pending = timer->pprev != NULL;
+	if (pending) {
+		ktimer_unlink(timer);
+	}
+	ktimer_unlock(flags);
+	return pending;
+}
+
+bool ktimer_pending(const ktimer_t *timer) {
+	return timer && timer->pprev != NULL;
+}
+
+uint32_t ktimer_next_event(uint32_t limit) {
+	// Up to the root's wrap, slot order is expiry order.
+	uint32_t idx = wheel_tick & WHEEL_ROOT_MASK;
+	uint32_t span = WHEEL_ROOT_SIZE - idx;
+	for (uint32_t off = 0; off < span; off++) {
+		if ((int32_t)(limit - (wheel_tick + off)) <= 0) {
+			return limit;
+		}
+		if (wheel_root[idx + off]) {
+			return wheel_tick + off;
+		}
+	}
+
+	// Past the wrap: the root slots behind idx, then anything still in the
+	// outer levels, whose slots span many ticks and need their lists read.
+	uint32_t next = limit;
+	for (uint32_t slot = 0; slot < idx; slot++) {
+		if (wheel_root[slot]) {
+			next = wheel_tick + span + slot;
+			break;
+		}
+	}
+	for (uint32_t level = 0; level < WHEEL_LEVELS; level++) {
+		for (uint32_t slot = 0; slot < WHEEL_LEVEL_SIZE; slot++) {
+			for (ktimer_t *timer = wheel_levels[level][slot]; timer; timer = timer->next) {
+				if ((int32_t)(timer->expires - next) < 0) {
+					next = timer->expires;
+				}
+			}
+		}
+	}
+	if ((int32_t)(limit - next) < 0) {
+		next = limit;
+	}
+	return next;
+}
+
+void ktimer_run(uint32_t now) {
+	while ((int32_t)(now - wheel_tick) >= 0) {
+		uint32_t idx = wheel_tick & WHEEL_ROOT_MASK;
+		if (idx == 0) {
+			uint32_t shift = WHEEL_ROOT_BITS;
+			for (uint32_t level = 0; level < WHEEL_LEVELS; level++) {
+				uint32_t slot = (wheel_tick >> shift) & WHEEL_LEVEL_MASK;
+				wheel_cascade(level, slot);
+				if (slot != 0) {
+					break;
+				}
+				shift += WHEEL_LEVEL_BITS;
+			}
+		}
+
+		// Detach the slot before running it: a callback re-adding its timer
+		// for this tick must land in the next slot, not this one.
+		ktimer_t *expired = wheel_root[idx];
+		wheel_root[idx] = NULL;
+		if (expired) {
+			expired->pprev = &expired;
+		}
+		wheel_tick++;
+
+		while (expired) {
+			ktimer_t *timer = expired;
+			ktimer_unlink(timer);
+			timer->fn(timer, timer->data);
+		}
+	}
+}
@@ -53,7 +53,6 @@
 #define ICMP_ECHO_REPLY 0
 
 #define ICMP_PAYLOAD_SIZE 32
-#define TIMER_TICK_MS 10
 
 #define UDP_PROTOCOL 17
 #define UDP_HEADER_LEN 8
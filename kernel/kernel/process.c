@@ -2,11 +2,20 @@
 #include <kernel/cpu.h>
 #include <kernel/elf.h>
 #include <kernel/fs.h>
+#include <kernel/fpu.h>
 #include <kernel/gdt.h>
-#include <kernel/kmalloc.h>
+#include <kernel/input.h>
 #include <kernel/memory.h>
 #include <kernel/pagings.h>
+#include <kernel/shm.h>
+#include <kernel/keyboard.h>
+#include <kernel/kmalloc.h>
 #include <kernel/kpti.h>
+#include <kernel/mouse.h>
+#include <kernel/slab.h>
+#include <kernel/syscall.h>
+#include <kernel/timer.h>
+#include <kernel/tty.h>
 #include <kernel/user_programs.h>
 #include <string.h>
 
@@ -17,24 +26,32 @@ static process_t *all_head = NULL;
 static uint32_t next_pid = 1;
 static char default_cwd[USERMODE_MAX_PATH] = "/";
 static bool scheduler_active = false;
+static uint32_t last_boost_tick = 0;
+static bool boost_pending = false;
+static kmem_cache_t *process_cache = NULL;
+static kmem_cache_t *pipe_cache = NULL;
+static kmem_cache_t *file_cache = NULL;
 
-// Pipe support (simple blocking pipes for user processes).
-#define PIPE_BUFFER_SIZE 1024
-#define PIPE_WAIT_NONE 0
-#define PIPE_WAIT_READ 1
-#define PIPE_WAIT_WRITE 2
+// Pipe support (blocking pipes for user processes). The ring is a run of
+// contiguous frames reached through the direct map; it starts at one page
+// and doubles when a writer would block, up to the pipe's limit.
 
 struct pipe {
-	uint8_t buffer[PIPE_BUFFER_SIZE];
+	uint8_t *buffer;
+	uint32_t size;                  // Ring bytes, a power of two
+	uint32_t limit;                 // Largest size the ring may grow to
 	uint32_t read_pos;
 	uint32_t write_pos;
 	uint32_t count;
 	uint32_t readers;
 	uint32_t writers;
+	wait_queue_t read_waiters;
+	wait_queue_t write_waiters;
+	wait_queue_t poll_waiters;      // poll() on either end
 };
 
 // Kernel stack allocator with guard pages.
-#define KERNEL_STACK_BASE (KERNEL_VIRT_BASE + USER_SPACE_START)
+#define KERNEL_STACK_BASE KERNEL_STACK_REGION_BASE
 #define KERNEL_STACK_SLOT_SIZE (2 * PAGE_SIZE)
 #define KERNEL_STACK_SLOTS 128
 
@@ -44,7 +61,14 @@ static uint32_t kernel_stack_deferred_count = 0;
 
 static void pipe_wake_readers(pipe_t *pipe);
 static void pipe_wake_writers(pipe_t *pipe);
-static void pipe_wait_clear(process_t *proc);
+static void process_wait_cancel(process_t *proc);
+static void process_input_run(void);
+static void process_sleep_expired(ktimer_t *timer, void *data);
+static void process_sleep_cancel(process_t *proc);
+static bool process_init_fds(process_t *proc);
+static bool process_fd_share_all(process_t *child, process_t *parent);
+static void process_end_threads(process_t *leader, process_t *keep);
+static void process_age_all(void);
 
 static inline bool kernel_stack_slot_used(uint32_t idx) {
 	return (kernel_stack_bitmap[idx / 8] & (1u << (idx % 8))) != 0;
@@ -78,20 +102,6 @@ static uint32_t align_up_page(uint32_t value) {
 	return (value + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
 }
 
-static void process_init_fds(process_t *proc) {
-	for (int i = 0; i < PROCESS_MAX_FDS; i++) {
-		proc->fds[i].used = false;
-		proc->fds[i].type = PROCESS_FD_NONE;
-		proc->fds[i].path[0] = '\0';
-		proc->fds[i].offset = 0;
-		proc->fds[i].pipe = NULL;
-	}
-	for (int i = 0; i < 3 && i < PROCESS_MAX_FDS; i++) {
-		proc->fds[i].used = true;
-		proc->fds[i].type = PROCESS_FD_TTY;
-	}
-}
-
 static bool kernel_stack_alloc(void **out_base, uint32_t *out_top) {
 	if (!out_base || !out_top) {
 		return false;
@@ -226,6 +236,21 @@ static uint8_t process_clamp_priority(uint8_t priority) {
 	return priority;
 }
 
+static uint32_t process_quantum(uint8_t priority) {
+	return PROCESS_TIME_QUANTUM << priority;
+}
+
+// Highest level the process's nice value lets it reach by aging; input and
+// pipe wakeups may lift it one level further.
+static uint8_t process_top_priority(const process_t *proc) {
+	if (proc->nice < 0) {
+		return 0;
+	}
+	return (uint8_t)(PROCESS_PRIORITY_DEFAULT +
+	                 proc->nice * (PROCESS_PRIORITY_LEVELS - 1 - PROCESS_PRIORITY_DEFAULT) /
+	                 PROCESS_NICE_MAX);
+}
+
 static bool process_ready_any(void) {
 	for (uint8_t i = 0; i < PROCESS_PRIORITY_LEVELS; i++) {
 		if (ready_heads[i]) {
@@ -235,6 +260,20 @@ static bool process_ready_any(void) {
 	return false;
 }
 
+// Halt until an interrupt makes some process runnable. Keyboard and mouse
+// input is handed to waiting readers here, since that copies into user pages.
+static void process_idle_until_ready(void) {
+	for (;;) {
+		if (keyboard_has_input() || mouse_has_input() || input_has_events()) {
+			process_input_run();
+		}
+		if (process_ready_any()) {
+			return;
+		}
+		timer_idle();
+	}
+}
+
 static int process_ready_highest_priority(void) {
 	for (uint8_t i = 0; i < PROCESS_PRIORITY_LEVELS; i++) {
 		if (ready_heads[i]) {
@@ -250,7 +289,11 @@ static void process_ready_enqueue(process_t *proc) {
 	}
 	uint8_t priority = process_clamp_priority(proc->priority);
 	proc->priority = priority;
-	proc->time_slice = PROCESS_TIME_QUANTUM;
+	// A process keeps what is left of its quantum across sleeps, so yielding
+	// just before it runs out does not keep a CPU hog at a high level.
+	if (proc->time_slice == 0) {
+		proc->time_slice = process_quantum(priority);
+	}
 	proc->reschedule = false;
 	proc->next = NULL;
 	if (!ready_tails[priority]) {
@@ -326,74 +369,83 @@ static bool process_user_ptr_ok(process_t *proc, uint32_t addr, uint32_t size) {
 }
 
 static void process_close_all_fds(process_t *proc) {
-	if (!proc) {
+	// Threads use their leader's table.
+	if (!proc || proc->leader) {
 		return;
 	}
-	for (int i = 0; i < PROCESS_MAX_FDS; i++) {
-		process_fd_close(proc, i);
+	for (uint32_t i = 0; i < proc->fd_size; i++) {
+		process_fd_close(proc, (int)i);
 	}
 }
 
-static void process_sanitize_fds(process_t *proc) {
-	if (!proc) {
-		return;
-	}
-	for (int i = 0; i < PROCESS_MAX_FDS; i++) {
-		process_fd_t *fd = &proc->fds[i];
-		if (!fd->used) {
-			fd->type = PROCESS_FD_NONE;
-			fd->path[0] = '\0';
-			fd->offset = 0;
-			fd->pipe = NULL;
-			continue;
-		}
-		if (fd->type == PROCESS_FD_NONE) {
-			fd->used = false;
-			fd->path[0] = '\0';
-			fd->offset = 0;
-			fd->pipe = NULL;
-			continue;
-		}
-		if ((fd->type == PROCESS_FD_PIPE_READ || fd->type == PROCESS_FD_PIPE_WRITE) &&
-		    !fd->pipe) {
-			fd->used = false;
-			fd->type = PROCESS_FD_NONE;
-			fd->path[0] = '\0';
-			fd->offset = 0;
-			fd->pipe = NULL;
-		}
-	}
-}
+// Processes blocked in process_wait, woken with the exiting process as key.
+static wait_queue_t exit_waiters;
+
+// Futex waiters, hashed by key. See futex_key.
+#define FUTEX_BUCKETS 32
+static wait_queue_t futex_queues[FUTEX_BUCKETS];
 
 static void process_write_status(process_t *proc, int status) {
-	if (!proc || proc->wait_status_ptr == 0) {
+	if (!proc || proc->wait_buf == 0) {
 		return;
 	}
-	if (!process_user_ptr_ok(proc, proc->wait_status_ptr, sizeof(int))) {
+	if (!process_user_ptr_ok(proc, proc->wait_buf, sizeof(int))) {
 		return;
 	}
-	page_copy_to_user(proc->page_directory, proc->wait_status_ptr,
+	page_copy_to_user(proc->page_directory, proc->wait_buf,
 	                  &status, sizeof(status));
 }
 
-static void process_wake_waiters(process_t *exiting, int exit_code, bool *had_waiter) {
-	for (process_t *proc = all_head; proc; proc = proc->all_next) {
-		if (proc->state != PROCESS_BLOCKED || !proc->waiting) {
-			continue;
-		}
-		if (proc->wait_pid >= 0 && (uint32_t)proc->wait_pid != exiting->pid) {
-			continue;
-		}
-		proc->waiting = false;
-		proc->wait_pid = 0;
-		process_write_status(proc, exit_code);
-		proc->wait_status_ptr = 0;
-		proc->frame.eax = exiting->pid;
-		proc->state = PROCESS_READY;
-		process_ready_enqueue(proc);
-		if (had_waiter) {
-			*had_waiter = true;
-		}
+// Finish the system call `proc` is blocked in with `result` (-1 for any
+// negative value) and make it runnable.
+static void process_wait_finish(process_t *proc, int result, bool boost) {
+	proc->frame.eax = (result < 0) ? (uint32_t)-1 : (uint32_t)result;
+	proc->wait_obj = NULL;
+	proc->wait_buf = 0;
+	proc->wait_len = 0;
+	proc->wait_done = 0;
+	proc->wait_pid = 0;
+	proc->state = PROCESS_READY;
+	if (boost) {
+		process_boost(proc);
+	}
+	process_ready_enqueue(proc);
+}
+
+// Take the process off every poll queue. Entries can outlive the poll()
+// that queued them (a timeout leaves them for process context to remove),
+// so this checks all of them rather than just poll_count.
+static void process_poll_detach(process_t *proc) {
+	for (uint32_t i = 0; i < PROCESS_POLL_MAX; i++) {
+		wait_queue_remove(&proc->poll_entries[i]);
+	}
+	proc->poll_count = 0;
+}
+
+static void process_wait_cancel(process_t *proc) {
+	wait_queue_remove(&proc->wait);
+	process_poll_detach(proc);
+	proc->wait_obj = NULL;
+	proc->wait_buf = 0;
+	proc->wait_len = 0;
+	proc->wait_done = 0;
+	proc->wait_pid = 0;
+}
+
+static bool process_exit_wake(wait_entry_t *entry, void *key) {
+	process_t *proc = (process_t *)entry->data;
+	process_t *exiting = (process_t *)key;
+	if (proc->wait_pid >= 0 && (uint32_t)proc->wait_pid != exiting->pid) {
+		return false;
+	}
+	process_write_status(proc, exiting->exit_code);
+	process_wait_finish(proc, (int)exiting->pid, false);
+	return true;
+}
+
+static void process_wake_waiters(process_t *exiting, bool *had_waiter) {
+	if (wake_up(&exit_waiters, UINT32_MAX, exiting) > 0 && had_waiter) {
+		*had_waiter = true;
 	}
 }
 
@@ -406,13 +458,27 @@ void process_init(void) {
 	}
 	all_head = NULL;
 	next_pid = 1;
+	wait_queue_init(&exit_waiters);
+	for (uint32_t i = 0; i < FUTEX_BUCKETS; i++) {
+		wait_queue_init(&futex_queues[i]);
+	}
 	default_cwd[0] = '/';
 	default_cwd[1] = '\0';
 	scheduler_active = false;
+	if (!process_cache) {
+		process_cache = kmem_cache_create("process", sizeof(process_t), 0, NULL);
+	}
+	if (!pipe_cache) {
+		pipe_cache = kmem_cache_create("pipe", sizeof(pipe_t), 0, NULL);
+	}
+	if (!file_cache) {
+		file_cache = kmem_cache_create("file", sizeof(process_file_t), 0, NULL);
+	}
 }
 
-process_t *process_create(const char *name) {
-	process_t *proc = kmalloc(sizeof(process_t));
+// A process with a pid and kernel stack but no descriptors or image yet.
+static process_t *process_alloc(const char *name) {
+	process_t *proc = kmem_cache_alloc(process_cache);
 	if (!proc) {
 		return NULL;
 	}
@@ -427,9 +493,11 @@ process_t *process_create(const char *name) {
 	proc->name[sizeof(proc->name) - 1] = '\0';
 	proc->state = PROCESS_READY;
 	proc->priority = PROCESS_PRIORITY_DEFAULT;
-	proc->time_slice = PROCESS_TIME_QUANTUM;
+	proc->nice = 0;
+	proc->time_slice = process_quantum(PROCESS_PRIORITY_DEFAULT);
 	proc->total_time = 0;
 	proc->reschedule = false;
+	ktimer_init(&proc->sleep_timer, process_sleep_expired, proc);
 
 	strncpy(proc->cwd, default_cwd, sizeof(proc->cwd) - 1);
 	proc->cwd[sizeof(proc->cwd) - 1] = '\0';
@@ -439,22 +507,29 @@ process_t *process_create(const char *name) {
 	proc->user_stack_top = USER_STACK_TOP;
 	proc->heap_base = 0;
 	proc->heap_end = 0;
+	proc->surface_size = 0;
 	proc->kernel_stack_base = NULL;
 	proc->kernel_stack_top = 0;
+	proc->user_cr3 = 0;
 	proc->uid = PROCESS_DEFAULT_UID;
 	proc->gid = PROCESS_DEFAULT_GID;
+	wait_entry_init(&proc->wait, NULL, proc);
 	if (!kernel_stack_alloc(&proc->kernel_stack_base, &proc->kernel_stack_top)) {
 		process_destroy(proc);
 		return NULL;
 	}
+	return proc;
+}
 
-	process_init_fds(proc);
-	proc->pipe_wait = NULL;
-	proc->pipe_wait_op = PIPE_WAIT_NONE;
-	proc->pipe_wait_buf = 0;
-	proc->pipe_wait_len = 0;
-	proc->pipe_wait_done = 0;
-
+process_t *process_create(const char *name) {
+	process_t *proc = process_alloc(name);
+	if (!proc) {
+		return NULL;
+	}
+	if (!process_init_fds(proc)) {
+		process_destroy(proc);
+		return NULL;
+	}
 	process_all_add(proc);
 	return proc;
 }
@@ -466,11 +541,26 @@ void process_destroy(process_t *proc) {
 	if (current_process == proc) {
 		current_process = NULL;
 	}
-	pipe_wait_clear(proc);
+	process_wait_cancel(proc);
+	process_sleep_cancel(proc);
 	process_close_all_fds(proc);
-	if (proc->page_directory) {
+	kfree(proc->fds);
+	proc->fds = NULL;
+	proc->fd_size = 0;
+	fpu_release(proc);
+	if (proc->leader) {
+		// The directory is the leader's; only this thread's stack leaves it.
+		if (kpti_enabled() && proc->page_directory && proc->kernel_stack_base) {
+			page_unmap(proc->page_directory, (uint32_t)proc->kernel_stack_base, false);
+		}
+		proc->leader->threads--;
+		proc->leader = NULL;
+		proc->page_directory = NULL;
+		proc->user_cr3 = 0;
+	} else if (proc->page_directory) {
 		page_directory_destroy(proc->page_directory);
 		proc->page_directory = NULL;
+		proc->user_cr3 = 0;
 	}
 	if (proc->kernel_stack_base) {
 		kernel_stack_free(proc->kernel_stack_base);
@@ -478,7 +568,7 @@ void process_destroy(process_t *proc) {
 		proc->kernel_stack_top = 0;
 	}
 	process_all_remove(proc);
-	kfree(proc);
+	kmem_cache_free(process_cache, proc);
 }
 
 void process_activate(process_t *proc) {
@@ -488,6 +578,7 @@ void process_activate(process_t *proc) {
 	if (proc->kernel_stack_top) {
 		tss_set_kernel_stack(proc->kernel_stack_top);
 	}
+	fpu_switch(proc);
 }
 
 void process_activate_user(process_t *proc) {
@@ -515,6 +606,10 @@ void process_set_current(process_t *proc) {
 	current_process = proc;
 }
 
+process_t *process_group_leader(process_t *proc) {
+	return (proc && proc->leader) ? proc->leader : proc;
+}
+
 uint32_t process_get_count(void) {
 	uint32_t count = 0;
 	for (process_t *proc = all_head; proc; proc = proc->all_next) {
@@ -534,6 +629,7 @@ uint32_t process_list(process_info_t *out, uint32_t max) {
 		info->pid = proc->pid;
 		info->state = (uint8_t)proc->state;
 		info->priority = proc->priority;
+		info->nice = proc->nice;
 		info->time_slice = proc->time_slice;
 		info->total_time = proc->total_time;
 		strncpy(info->name, proc->name, PROCESS_NAME_MAX - 1);
@@ -559,8 +655,14 @@ void process_set_cwd(process_t *proc, const char *path) {
 	if (!proc || !path || path[0] == '\0') {
 		return;
 	}
-	strncpy(proc->cwd, path, sizeof(proc->cwd) - 1);
-	proc->cwd[sizeof(proc->cwd) - 1] = '\0';
+	// Every thread keeps a copy of the group's cwd.
+	process_t *leader = process_group_leader(proc);
+	for (process_t *member = all_head; member; member = member->all_next) {
+		if (process_group_leader(member) == leader) {
+			strncpy(member->cwd, path, sizeof(member->cwd) - 1);
+			member->cwd[sizeof(member->cwd) - 1] = '\0';
+		}
+	}
 }
 
 const char *process_get_cwd(process_t *proc) {
@@ -603,6 +705,16 @@ uint32_t process_get_args(process_t *proc, char *dst, uint32_t max_len) {
 	return total;
 }
 
+// Return to `next` through `frame`, keeping the kernel stack pointer of the
+// frame being replaced.
+static void process_load_frame(trap_frame_t *frame, process_t *next) {
+	uint32_t kernel_esp = frame->esp;
+	memcpy(frame, &next->frame, sizeof(*frame));
+	frame->esp = kernel_esp;
+	// No longer the frame SYSENTER built: leave through iret.
+	syscall_sysenter_frame = 0;
+}
+
 static bool process_block_and_switch(trap_frame_t *frame, process_t *current) {
 	if (!frame || !current) {
 		return true;
@@ -610,9 +722,7 @@ static bool process_block_and_switch(trap_frame_t *frame, process_t *current) {
 	current->state = PROCESS_BLOCKED;
 	memcpy(&current->frame, frame, sizeof(*frame));
 
-	while (!process_ready_any()) {
-		cpu_hlt();
-	}
+	process_idle_until_ready();
 
 	process_t *next = process_ready_dequeue();
 	if (!next) {
@@ -624,17 +734,29 @@ static bool process_block_and_switch(trap_frame_t *frame, process_t *current) {
 	next->state = PROCESS_RUNNING;
 	next->reschedule = false;
 	if (next->time_slice == 0) {
-		next->time_slice = PROCESS_TIME_QUANTUM;
+		next->time_slice = process_quantum(next->priority);
 	}
 	process_activate(next);
 	kernel_stack_flush_deferred();
-	uint32_t kernel_esp = frame->esp;
-	memcpy(frame, &next->frame, sizeof(*frame));
-	frame->esp = kernel_esp;
+	process_load_frame(frame, next);
+	return false;
+}
+
+// Block the caller on `queue` until `wake` finishes its system call.
+// Returns true if nothing else could run and the caller must fail the call.
+static bool process_block_on(trap_frame_t *frame, process_t *proc,
+                             wait_queue_t *queue, wait_fn_t wake) {
+	wait_entry_init(&proc->wait, wake, proc);
+	wait_queue_add(queue, &proc->wait);
+	if (process_block_and_switch(frame, proc)) {
+		process_wait_cancel(proc);
+		return true;
+	}
 	return false;
 }
 
 bool process_brk(process_t *proc, uint32_t new_end, uint32_t *out_end) {
+	proc = process_group_leader(proc);
 	if (!proc || !proc->page_directory) {
 		return false;
 	}
@@ -642,7 +764,7 @@ bool process_brk(process_t *proc, uint32_t new_end, uint32_t *out_end) {
 		return false;
 	}
 
-	uint32_t limit = USER_STACK_TOP - USER_STACK_SIZE;
+	uint32_t limit = USER_HEAP_LIMIT;
 	uint32_t current = proc->heap_end;
 
 	if (new_end == 0) {
@@ -683,6 +805,30 @@ bool process_brk(process_t *proc, uint32_t new_end, uint32_t *out_end) {
 	return true;
 }
 
+// Map (or grow) the drawing surface with zeroed pages. The surface is plain
+// user memory, so fork shares it copy-on-write like the rest of the image.
+bool process_map_surface(process_t *proc, uint32_t size) {
+	proc = process_group_leader(proc);
+	if (!proc || !proc->page_directory || size == 0 || size > USER_SURFACE_SIZE) {
+		return false;
+	}
+	uint32_t map_start = USER_SURFACE_BASE + proc->surface_size;
+	uint32_t map_end = USER_SURFACE_BASE + align_up_page(size);
+	for (uint32_t addr = map_start; addr < map_end; addr += PAGE_SIZE) {
+		if (!page_map_alloc(proc->page_directory, addr, PAGE_RW | PAGE_USER, NULL)) {
+			for (uint32_t undo = map_start; undo < addr; undo += PAGE_SIZE) {
+				page_unmap(proc->page_directory, undo, true);
+			}
+			return false;
+		}
+		page_memset_user(proc->page_directory, addr, 0, PAGE_SIZE);
+	}
+	if (map_end > map_start) {
+		proc->surface_size = map_end - USER_SURFACE_BASE;
+	}
+	return true;
+}
+
 static void process_setup_frame(process_t *proc) {
 	memset(&proc->frame, 0, sizeof(proc->frame));
 	proc->frame.eip = proc->entry;
@@ -726,7 +872,10 @@ static bool process_clone_cow(uint32_t *parent_dir, uint32_t *child_dir, bool *o
 			uint32_t phys = pte & ~0xFFF;
 			uint32_t flags = pte & 0xFFF;
 			if (flags & PAGE_USER) {
-				if (flags & PAGE_RW) {
+				if (flags & PAGE_SHARED) {
+					child_table[j] = pte;
+					frame_ref_inc(phys);
+				} else if (flags & PAGE_RW) {
 					uint32_t cow_flags = (flags & ~PAGE_RW) | PAGE_COW;
 					parent_table[j] = phys | cow_flags;
 					child_table[j] = phys | cow_flags;
@@ -749,7 +898,8 @@ static bool process_clone_cow(uint32_t *parent_dir, uint32_t *child_dir, bool *o
 }
 
 bool process_exec(process_t *proc, const char *path, const char *args, uint32_t args_len) {
-	if (!proc || !path || path[0] == '\0') {
+	// Only the group leader may replace the image; the other threads end.
+	if (!proc || proc->leader || !path || path[0] == '\0') {
 		return false;
 	}
 
@@ -773,7 +923,7 @@ bool process_exec(process_t *proc, const char *path, const char *args, uint32_t
 
 	uint32_t guard_base = USER_STACK_TOP - USER_STACK_SIZE;
 	uint32_t stack_bottom = guard_base + PAGE_SIZE;
-	if (image.max_vaddr >= stack_bottom) {
+	if (image.max_vaddr > USER_HEAP_LIMIT) {
 		page_directory_destroy(new_dir);
 		return false;
 	}
@@ -794,33 +944,43 @@ bool process_exec(process_t *proc, const char *path, const char *args, uint32_t
 	if (heap_base < ELF_USER_LOAD_MIN) {
 		heap_base = ELF_USER_LOAD_MIN;
 	}
-	if (heap_base > guard_base) {
+	if (heap_base > USER_HEAP_LIMIT) {
 		page_directory_destroy(new_dir);
 		return false;
 	}
 
-	kpti_map_kernel_pages(new_dir, proc);
+	// The clock page is shared by every process; each mapping holds a
+	// reference, so unmapping it on exit never frees the frame.
+	uint32_t vclock = timer_vclock_frame();
+	if (vclock) {
+		if (!page_map(new_dir, USER_VCLOCK_BASE, vclock, PAGE_USER)) {
+			page_directory_destroy(new_dir);
+			return false;
+		}
+		frame_ref_inc(vclock);
+	}
+
+	if (!kpti_map_kernel_pages(new_dir, proc)) {
+		page_directory_destroy(new_dir);
+		return false;
+	}
 
+	process_end_threads(proc, NULL);
 	if (proc->page_directory) {
 		page_directory_destroy(proc->page_directory);
 	}
 
 	proc->page_directory = new_dir;
+	proc->user_cr3 = virt_to_phys(new_dir);
 	proc->entry = image.entry;
 	proc->user_stack_top = USER_STACK_TOP;
 	proc->heap_base = heap_base;
 	proc->heap_end = heap_base;
-	proc->pipe_wait = NULL;
-	proc->pipe_wait_op = PIPE_WAIT_NONE;
-	proc->pipe_wait_buf = 0;
-	proc->pipe_wait_len = 0;
-	proc->pipe_wait_done = 0;
-	proc->waiting = false;
-	proc->wait_pid = 0;
-	proc->wait_status_ptr = 0;
-	proc->sleeping = false;
-	proc->sleep_until = 0;
-	process_sanitize_fds(proc);
+	proc->surface_size = 0;
+	process_wait_cancel(proc);
+	process_sleep_cancel(proc);
+	// The new image starts from a clean FPU on its first FP instruction.
+	fpu_release(proc);
 	process_set_args(proc, args, args_len);
 	process_setup_frame(proc);
 	return true;
@@ -845,38 +1005,35 @@ int process_fork(trap_frame_t *frame) {
 	if (!parent || !frame || !parent->page_directory) {
 		return -1;
 	}
+	// The child gets a copy of the whole process, with only the calling
+	// thread in it.
+	process_t *group = process_group_leader(parent);
 
 	process_t *child = process_create(parent->name);
 	if (!child) {
 		return -1;
 	}
 	child->priority = parent->priority;
+	child->nice = parent->nice;
+	child->time_slice = process_quantum(child->priority);
 	strncpy(child->cwd, parent->cwd, sizeof(child->cwd) - 1);
 	child->cwd[sizeof(child->cwd) - 1] = '\0';
 	process_set_args(child, parent->args, parent->args_len);
-	memcpy(child->fds, parent->fds, sizeof(child->fds));
-	process_sanitize_fds(child);
-	for (int i = 0; i < PROCESS_MAX_FDS; i++) {
-		if (!child->fds[i].used) {
-			continue;
-		}
-		if (child->fds[i].type == PROCESS_FD_PIPE_READ) {
-			pipe_retain_read(child->fds[i].pipe);
-		} else if (child->fds[i].type == PROCESS_FD_PIPE_WRITE) {
-			pipe_retain_write(child->fds[i].pipe);
-		}
+	if (!process_fd_share_all(child, parent)) {
+		process_destroy(child);
+		return -1;
 	}
-	child->entry = parent->entry;
+	child->entry = group->entry;
 	child->user_stack_top = parent->user_stack_top;
-	child->heap_base = parent->heap_base;
-	child->heap_end = parent->heap_end;
+	child->heap_base = group->heap_base;
+	child->heap_end = group->heap_end;
+	child->surface_size = group->surface_size;
 	child->uid = parent->uid;
 	child->gid = parent->gid;
-	child->pipe_wait = NULL;
-	child->pipe_wait_op = PIPE_WAIT_NONE;
-	child->pipe_wait_buf = 0;
-	child->pipe_wait_len = 0;
-	child->pipe_wait_done = 0;
+	if (!fpu_fork(parent, child)) {
+		process_destroy(child);
+		return -1;
+	}
 
 	uint32_t *child_dir = page_directory_create();
 	if (!child_dir) {
@@ -890,7 +1047,17 @@ int process_fork(trap_frame_t *frame) {
 		process_destroy(child);
 		return -1;
 	}
-	kpti_map_kernel_pages(child_dir, child);
+	if (!kpti_map_kernel_pages(child_dir, child)) {
+		process_destroy(child);
+		return -1;
+	}
+	child->user_cr3 = virt_to_phys(child_dir);
+	// The parent's writable pages just became copy-on-write. With KPTI the
+	// return path reloads CR3 anyway; without it the stale TLB entries must go.
+	uint32_t parent_cr3 = virt_to_phys(parent->page_directory);
+	if (modified && read_cr3() == parent_cr3) {
+		write_cr3(parent_cr3);
+	}
 
 	memcpy(&child->frame, frame, sizeof(*frame));
 	child->frame.eax = 0;
@@ -914,17 +1081,21 @@ bool process_schedule(trap_frame_t *frame) {
 	if (!current) {
 		return false;
 	}
+	if (keyboard_has_input() || mouse_has_input() || input_has_events()) {
+		process_input_run();
+	}
+	if (boost_pending) {
+		boost_pending = false;
+		process_age_all();
+	}
 	int ready_prio = process_ready_highest_priority();
 	if (ready_prio < 0) {
 		memcpy(&current->frame, frame, sizeof(*frame));
-		if (current->time_slice == 0) {
-			current->time_slice = PROCESS_TIME_QUANTUM;
-			current->reschedule = false;
-		}
+		current->reschedule = false;
 		return false;
 	}
 
-	bool should_preempt = current->reschedule || current->time_slice == 0;
+	bool should_preempt = current->reschedule;
 	if (ready_prio < current->priority) {
 		should_preempt = true;
 	}
@@ -943,9 +1114,6 @@ bool process_schedule(trap_frame_t *frame) {
 	if (!next) {
 		current->state = PROCESS_RUNNING;
 		current->reschedule = false;
-		if (current->time_slice == 0) {
-			current->time_slice = PROCESS_TIME_QUANTUM;
-		}
 		return false;
 	}
 
@@ -953,34 +1121,31 @@ bool process_schedule(trap_frame_t *frame) {
 	next->state = PROCESS_RUNNING;
 	next->reschedule = false;
 	if (next->time_slice == 0) {
-		next->time_slice = PROCESS_TIME_QUANTUM;
+		next->time_slice = process_quantum(next->priority);
 	}
 	process_activate(next);
 	kernel_stack_flush_deferred();
-	uint32_t kernel_esp = frame->esp;
-	memcpy(frame, &next->frame, sizeof(*frame));
-	frame->esp = kernel_esp;
+	process_load_frame(frame, next);
 	return true;
 }
 
-bool process_exit_current(trap_frame_t *frame, int code) {
-	process_t *current = current_process;
-	if (!current) {
-		return false;
-	}
-	current->exit_code = code;
-	bool had_waiter = false;
-	process_wake_waiters(current, code, &had_waiter);
-	pipe_wait_clear(current);
-	process_close_all_fds(current);
-
-	current->state = PROCESS_ZOMBIE;
-	if (current->page_directory) {
-		process_activate_kernel();
-		page_directory_destroy(current->page_directory);
-		current->page_directory = NULL;
+// Destroy every thread of `leader`'s group but `keep` (the caller, if it
+// is one of them).
+static void process_end_threads(process_t *leader, process_t *keep) {
+	process_t *proc = all_head;
+	while (proc && leader->threads > 0) {
+		process_t *next = proc->all_next;
+		if (proc->leader == leader && proc != keep) {
+			process_ready_remove(proc);
+			process_destroy(proc);
+		}
+		proc = next;
 	}
+}
 
+// Run the next ready process after the current one went away. Returns
+// false, with the scheduler stopped, if there is none.
+static bool process_switch_after_exit(trap_frame_t *frame) {
 	current_process = NULL;
 	process_t *next = process_ready_dequeue();
 	if (!next) {
@@ -992,16 +1157,50 @@ bool process_exit_current(trap_frame_t *frame, int code) {
 	next->state = PROCESS_RUNNING;
 	next->reschedule = false;
 	if (next->time_slice == 0) {
-		next->time_slice = PROCESS_TIME_QUANTUM;
+		next->time_slice = process_quantum(next->priority);
 	}
 	process_activate(next);
 	kernel_stack_flush_deferred();
-	uint32_t kernel_esp = frame->esp;
-	memcpy(frame, &next->frame, sizeof(*frame));
-	frame->esp = kernel_esp;
+	process_load_frame(frame, next);
 	return true;
 }
 
+static void process_kill(process_t *target, int exit_code);
+
+bool process_exit_current(trap_frame_t *frame, int code) {
+	process_t *current = current_process;
+	if (!current) {
+		return false;
+	}
+	// Any thread exiting ends the whole group. The leader stays behind as
+	// the zombie carrying the status.
+	process_t *leader = process_group_leader(current);
+	process_end_threads(leader, current);
+	if (current != leader) {
+		// The group's directory may still be in CR3; leave it before it is
+		// torn down.
+		process_activate_kernel();
+		process_destroy(current);
+		process_kill(leader, code);
+		return process_switch_after_exit(frame);
+	}
+	current->exit_code = code;
+	bool had_waiter = false;
+	process_wake_waiters(current, &had_waiter);
+	process_wait_cancel(current);
+	process_close_all_fds(current);
+	fpu_release(current);
+
+	current->state = PROCESS_ZOMBIE;
+	if (current->page_directory) {
+		process_activate_kernel();
+		page_directory_destroy(current->page_directory);
+		current->page_directory = NULL;
+		current->user_cr3 = 0;
+	}
+	return process_switch_after_exit(frame);
+}
+
 bool process_wait(trap_frame_t *frame, int32_t pid, uint32_t status_ptr,
                   int *out_pid, int *out_status) {
 	if (!frame || !out_pid || !out_status) {
@@ -1028,46 +1227,25 @@ bool process_wait(trap_frame_t *frame, int32_t pid, uint32_t status_ptr,
 		return true;
 	}
 
-	if (pid >= 0 && !process_find((uint32_t)pid)) {
+	// Threads never become zombies; join them with a futex on clear_tid.
+	process_t *target = pid >= 0 ? process_find((uint32_t)pid) : NULL;
+	if (pid >= 0 && (!target || target->leader)) {
 		*out_pid = -1;
 		*out_status = -1;
 		return true;
 	}
 
-	current->waiting = true;
 	current->wait_pid = pid;
-	current->wait_status_ptr = status_ptr;
-	current->state = PROCESS_BLOCKED;
-	memcpy(&current->frame, frame, sizeof(*frame));
-
-	while (!process_ready_any()) {
-		cpu_hlt();
-	}
-
-	process_t *next = process_ready_dequeue();
-	if (!next) {
-		current->waiting = false;
-		current->state = PROCESS_RUNNING;
+	current->wait_buf = status_ptr;
+	if (process_block_on(frame, current, &exit_waiters, process_exit_wake)) {
 		*out_pid = -1;
 		*out_status = -1;
 		return true;
 	}
-
-	current_process = next;
-	next->state = PROCESS_RUNNING;
-	next->reschedule = false;
-	if (next->time_slice == 0) {
-		next->time_slice = PROCESS_TIME_QUANTUM;
-	}
-	process_activate(next);
-	kernel_stack_flush_deferred();
-	uint32_t kernel_esp = frame->esp;
-	memcpy(frame, &next->frame, sizeof(*frame));
-	frame->esp = kernel_esp;
 	return false;
 }
 
-bool process_sleep_until(trap_frame_t *frame, uint32_t wake_tick) {
+bool process_sleep_until(trap_frame_t *frame, uint32_t wake_ms) {
 	if (!frame) {
 		return true;
 	}
@@ -1080,50 +1258,80 @@ bool process_sleep_until(trap_frame_t *frame, uint32_t wake_tick) {
 		return true;
 	}
 
-	current->sleeping = true;
-	current->sleep_until = wake_tick;
-	current->state = PROCESS_BLOCKED;
-	memcpy(&current->frame, frame, sizeof(*frame));
-
 	process_t *next = process_ready_dequeue();
 	if (!next) {
-		current->sleeping = false;
-		current->state = PROCESS_RUNNING;
 		return true;
 	}
 
+	current->state = PROCESS_BLOCKED;
+	memcpy(&current->frame, frame, sizeof(*frame));
+	ktimer_add(&current->sleep_timer, wake_ms);
+
 	current_process = next;
 	next->state = PROCESS_RUNNING;
 	next->reschedule = false;
 	if (next->time_slice == 0) {
-		next->time_slice = PROCESS_TIME_QUANTUM;
+		next->time_slice = process_quantum(next->priority);
 	}
 	process_activate(next);
 	kernel_stack_flush_deferred();
-	uint32_t kernel_esp = frame->esp;
-	memcpy(frame, &next->frame, sizeof(*frame));
-	frame->esp = kernel_esp;
+	process_load_frame(frame, next);
 	return false;
 }
 
-void process_tick(uint32_t now_ticks) {
+static void process_sleep_expired(ktimer_t *timer, void *data) {
+	(void)timer;
+	process_t *proc = (process_t *)data;
+	if (!proc || proc->state != PROCESS_BLOCKED) {
+		return;
+	}
+	// Poll entries stay queued: poll_wake drops them once wait_obj is clear.
+	proc->wait_obj = NULL;
+	proc->frame.eax = 0;
+	proc->state = PROCESS_READY;
+	process_ready_enqueue(proc);
+}
+
+static void process_sleep_cancel(process_t *proc) {
+	ktimer_cancel(&proc->sleep_timer);
+}
+
+// Put the process on a new level with a fresh quantum, requeueing it if it
+// is waiting to run.
+static void process_move_priority(process_t *proc, uint8_t priority) {
+	bool queued = proc->state == PROCESS_READY;
+	if (queued) {
+		process_ready_remove(proc);
+	}
+	proc->priority = priority;
+	proc->time_slice = process_quantum(priority);
+	if (queued) {
+		process_ready_enqueue(proc);
+	}
+}
+
+// Lift every process that sank below its top level back up to it, so CPU
+// hogs cannot starve and a process that turned interactive recovers.
+static void process_age_all(void) {
 	for (process_t *proc = all_head; proc; proc = proc->all_next) {
-		if (proc->state != PROCESS_BLOCKED || !proc->sleeping) {
-			continue;
-		}
-		if (now_ticks < proc->sleep_until) {
+		uint8_t top = process_top_priority(proc);
+		if (proc->priority <= top || proc->state == PROCESS_ZOMBIE) {
 			continue;
 		}
-		proc->sleeping = false;
-		proc->sleep_until = 0;
-		proc->frame.eax = 0;
-		proc->state = PROCESS_READY;
-		process_ready_enqueue(proc);
+		process_move_priority(proc, top);
 	}
+}
 
+void process_tick(uint32_t now_ticks) {
 	if (!scheduler_active) {
 		return;
 	}
+	// Aging requeues processes, so it waits for process_schedule, which only
+	// runs when no system call can be halfway through a queue update.
+	if (now_ticks - last_boost_tick >= PROCESS_BOOST_TICKS) {
+		last_boost_tick = now_ticks;
+		boost_pending = true;
+	}
 	process_t *current = current_process;
 	if (!current || current->state != PROCESS_RUNNING) {
 		return;
@@ -1131,10 +1339,51 @@ void process_tick(uint32_t now_ticks) {
 	current->total_time++;
 	if (current->time_slice > 0) {
 		current->time_slice--;
-		if (current->time_slice == 0) {
-			current->reschedule = true;
+	}
+	if (current->time_slice == 0) {
+		// Used the whole quantum: treat it as CPU-bound and move it down.
+		if (current->priority < PROCESS_PRIORITY_LEVELS - 1) {
+			current->priority++;
 		}
+		current->time_slice = process_quantum(current->priority);
+		current->reschedule = true;
+	}
+}
+
+// Call while the process is running or blocked, not while it is queued.
+void process_boost(process_t *proc) {
+	if (!proc) {
+		return;
+	}
+	uint8_t top = process_top_priority(proc);
+	uint8_t limit = top > 0 ? top - 1 : 0;
+	if (proc->priority > limit) {
+		proc->priority--;
 	}
+	proc->time_slice = process_quantum(proc->priority);
+}
+
+bool process_renice(uint32_t pid, int increment, int *out_nice) {
+	process_t *proc = pid == 0 ? current_process : process_find(pid);
+	if (!proc || proc->state == PROCESS_ZOMBIE) {
+		return false;
+	}
+	int nice = proc->nice + increment;
+	if (nice < PROCESS_NICE_MIN) {
+		nice = PROCESS_NICE_MIN;
+	} else if (nice > PROCESS_NICE_MAX) {
+		nice = PROCESS_NICE_MAX;
+	}
+	proc->nice = (int8_t)nice;
+	// Takes effect at the next aging pass, or now if it caps the level.
+	uint8_t top = process_top_priority(proc);
+	if (proc->priority < top) {
+		process_move_priority(proc, top);
+	}
+	if (out_nice) {
+		*out_nice = nice;
+	}
+	return true;
 }
 
 static void process_set_scheduler_active(bool active) {
@@ -1167,12 +1416,33 @@ process_t *process_spawn_proc(const char *path, const char *args, uint32_t args_
 	return proc;
 }
 
+static uint8_t *pipe_storage_alloc(uint32_t size) {
+	uint32_t phys = frame_alloc_contiguous(size / PAGE_SIZE);
+	return phys ? (uint8_t *)phys_to_virt(phys) : NULL;
+}
+
+static void pipe_storage_free(uint8_t *buffer, uint32_t size) {
+	if (buffer) {
+		frame_free_contiguous(virt_to_phys(buffer), size / PAGE_SIZE);
+	}
+}
+
 pipe_t *pipe_create(void) {
-	pipe_t *pipe = (pipe_t *)kmalloc(sizeof(pipe_t));
+	pipe_t *pipe = (pipe_t *)kmem_cache_alloc(pipe_cache);
 	if (!pipe) {
 		return NULL;
 	}
 	memset(pipe, 0, sizeof(*pipe));
+	pipe->buffer = pipe_storage_alloc(PIPE_MIN_SIZE);
+	if (!pipe->buffer) {
+		kmem_cache_free(pipe_cache, pipe);
+		return NULL;
+	}
+	pipe->size = PIPE_MIN_SIZE;
+	pipe->limit = PIPE_DEFAULT_SIZE;
+	wait_queue_init(&pipe->read_waiters);
+	wait_queue_init(&pipe->write_waiters);
+	wait_queue_init(&pipe->poll_waiters);
 	return pipe;
 }
 
@@ -1193,7 +1463,8 @@ static void pipe_maybe_free(pipe_t *pipe) {
 		return;
 	}
 	if (pipe->readers == 0 && pipe->writers == 0) {
-		kfree(pipe);
+		pipe_storage_free(pipe->buffer, pipe->size);
+		kmem_cache_free(pipe_cache, pipe);
 	}
 }
 
@@ -1219,98 +1490,326 @@ void pipe_release_write(pipe_t *pipe) {
 	pipe_maybe_free(pipe);
 }
 
-void process_fd_close(process_t *proc, int fd) {
-	if (!proc || fd < 0 || fd >= PROCESS_MAX_FDS) {
-		return;
+// Descriptor tables. Slots point at refcounted open files; the fd_open
+// bitmap finds the lowest free slot a word at a time. Threads have no
+// table of their own and use their leader's.
+static process_file_t *process_file_create(uint8_t type) {
+	if (!file_cache) {
+		return NULL;
+	}
+	process_file_t *file = (process_file_t *)kmem_cache_alloc(file_cache);
+	if (!file) {
+		return NULL;
 	}
-	process_fd_t *entry = &proc->fds[fd];
-	if (!entry->used) {
+	memset(file, 0, sizeof(*file));
+	file->refs = 1;
+	file->type = type;
+	return file;
+}
+
+static void process_file_release(process_file_t *file) {
+	if (!file || --file->refs > 0) {
 		return;
 	}
-	if (entry->type == PROCESS_FD_PIPE_READ) {
-		pipe_release_read(entry->pipe);
-	} else if (entry->type == PROCESS_FD_PIPE_WRITE) {
-		pipe_release_write(entry->pipe);
+	if (file->type == PROCESS_FD_PIPE_READ) {
+		pipe_release_read(file->pipe);
+	} else if (file->type == PROCESS_FD_PIPE_WRITE) {
+		pipe_release_write(file->pipe);
+	} else if (file->type == PROCESS_FD_INPUT) {
+		input_close();
+	} else if (file->type == PROCESS_FD_SHM) {
+		shm_release(file->shm);
 	}
-	entry->used = false;
-	entry->type = PROCESS_FD_NONE;
-	entry->path[0] = '\0';
-	entry->offset = 0;
-	entry->pipe = NULL;
+	if (file->path) {
+		kfree(file->path);
+	}
+	kmem_cache_free(file_cache, file);
 }
 
-bool process_fd_set_pipe(process_t *proc, int fd, pipe_t *pipe, bool writable) {
-	if (!proc || fd < 0 || fd >= PROCESS_MAX_FDS || !pipe) {
+static bool process_fd_grow(process_t *proc, uint32_t min_size) {
+	if (min_size > PROCESS_FD_LIMIT) {
+		return false;
+	}
+	if (min_size <= proc->fd_size) {
+		return true;
+	}
+	uint32_t size = proc->fd_size ? proc->fd_size : PROCESS_FD_INITIAL;
+	while (size < min_size) {
+		size *= 2;
+	}
+	process_file_t **fds = (process_file_t **)kmalloc(size * sizeof(process_file_t *));
+	if (!fds) {
+		return false;
+	}
+	memset(fds, 0, size * sizeof(process_file_t *));
+	if (proc->fds) {
+		memcpy(fds, proc->fds, proc->fd_size * sizeof(process_file_t *));
+		kfree(proc->fds);
+	}
+	proc->fds = fds;
+	proc->fd_size = size;
+	return true;
+}
+
+// Put `file` on `fd` with a new reference, closing what was there.
+static bool process_fd_install(process_t *proc, int fd, process_file_t *file) {
+	process_t *owner = process_group_leader(proc);
+	if (fd < 0 || !process_fd_grow(owner, (uint32_t)fd + 1)) {
 		return false;
 	}
 	process_fd_close(proc, fd);
-	proc->fds[fd].used = true;
-	proc->fds[fd].type = writable ? PROCESS_FD_PIPE_WRITE : PROCESS_FD_PIPE_READ;
-	proc->fds[fd].pipe = pipe;
-	proc->fds[fd].path[0] = '\0';
-	proc->fds[fd].offset = 0;
-	if (writable) {
-		pipe_retain_write(pipe);
-	} else {
-		pipe_retain_read(pipe);
+	file->refs++;
+	owner->fds[fd] = file;
+	owner->fd_open[fd / 32] |= 1u << (fd % 32);
+	return true;
+}
+
+static bool process_init_fds(process_t *proc) {
+	if (!process_fd_grow(proc, PROCESS_FD_INITIAL)) {
+		return false;
+	}
+	process_file_t *tty = process_file_create(PROCESS_FD_TTY);
+	if (!tty) {
+		return false;
 	}
+	for (int i = 0; i < 3; i++) {
+		process_fd_install(proc, i, tty);
+	}
+	process_file_release(tty);
 	return true;
 }
 
-static void pipe_peek(pipe_t *pipe, uint8_t *dst, uint32_t len) {
-	if (!pipe || !dst || len == 0) {
-		return;
+// Give the child the parent's descriptors, sharing the open files.
+static bool process_fd_share_all(process_t *child, process_t *parent) {
+	parent = process_group_leader(parent);
+	process_close_all_fds(child);
+	if (!process_fd_grow(child, parent->fd_size)) {
+		return false;
 	}
-	uint32_t first = PIPE_BUFFER_SIZE - pipe->read_pos;
-	if (len <= first) {
-		memcpy(dst, &pipe->buffer[pipe->read_pos], len);
-	} else {
-		memcpy(dst, &pipe->buffer[pipe->read_pos], first);
-		memcpy(dst + first, pipe->buffer, len - first);
+	for (uint32_t i = 0; i < parent->fd_size; i++) {
+		if (parent->fds[i]) {
+			process_fd_install(child, (int)i, parent->fds[i]);
+		}
 	}
+	return true;
 }
 
-static void pipe_discard(pipe_t *pipe, uint32_t len) {
-	if (!pipe || len == 0) {
-		return;
+process_file_t *process_fd_get(process_t *proc, int fd) {
+	proc = process_group_leader(proc);
+	if (!proc || fd < 0 || (uint32_t)fd >= proc->fd_size) {
+		return NULL;
+	}
+	return proc->fds[fd];
+}
+
+int process_fd_alloc(process_t *proc) {
+	proc = process_group_leader(proc);
+	if (!proc) {
+		return -1;
+	}
+	for (uint32_t word = 0; word * 32 < proc->fd_size; word++) {
+		uint32_t free_bits = ~proc->fd_open[word];
+		if (free_bits) {
+			uint32_t fd = word * 32 + (uint32_t)__builtin_ctz(free_bits);
+			if (fd < proc->fd_size) {
+				return (int)fd;
+			}
+		}
+	}
+	uint32_t fd = proc->fd_size;
+	return process_fd_grow(proc, fd + 1) ? (int)fd : -1;
+}
+
+int process_fd_open(process_t *proc, uint8_t type, const char *path) {
+	int fd = process_fd_alloc(proc);
+	if (fd < 0) {
+		return -1;
+	}
+	process_file_t *file = process_file_create(type);
+	if (!file) {
+		return -1;
+	}
+	if (type == PROCESS_FD_FILE) {
+		size_t len = path ? strlen(path) : 0;
+		file->path = (char *)kmalloc(len + 1);
+		if (!file->path) {
+			process_file_release(file);
+			return -1;
+		}
+		memcpy(file->path, path, len);
+		file->path[len] = '\0';
+	} else if (type == PROCESS_FD_INPUT) {
+		input_open();
+	}
+	process_fd_install(proc, fd, file);
+	process_file_release(file);
+	return fd;
+}
+
+// The table is shared, so other threads of the group may be waiting on a
+// pipe one of them closes. Drop their leftover poll entries, and fail the
+// calls blocked on it if this was the last reference.
+static void process_group_drop_pipe(process_t *proc, process_file_t *file) {
+	process_t *leader = process_group_leader(proc);
+	bool last = file->refs == 1 && file->pipe->readers + file->pipe->writers == 1;
+	for (process_t *member = all_head; member; member = member->all_next) {
+		if (member == proc || process_group_leader(member) != leader) {
+			continue;
+		}
+		bool polling = member->state == PROCESS_BLOCKED &&
+		               member->wait_obj == member->poll_entries;
+		if (!polling) {
+			process_poll_detach(member);
+		}
+		if (last && member->state == PROCESS_BLOCKED &&
+		    (polling || member->wait_obj == file->pipe)) {
+			process_sleep_cancel(member);
+			process_wait_cancel(member);
+			process_wait_finish(member, -1, false);
+		}
 	}
-	pipe->read_pos = (pipe->read_pos + len) % PIPE_BUFFER_SIZE;
-	pipe->count -= len;
 }
 
-static void pipe_write_buffer(pipe_t *pipe, const uint8_t *src, uint32_t len) {
-	if (!pipe || !src || len == 0) {
+void process_fd_close(process_t *proc, int fd) {
+	process_file_t *file = process_fd_get(proc, fd);
+	if (!file) {
 		return;
 	}
-	uint32_t first = PIPE_BUFFER_SIZE - pipe->write_pos;
-	if (len <= first) {
-		memcpy(&pipe->buffer[pipe->write_pos], src, len);
+	process_t *owner = process_group_leader(proc);
+	if (file->type == PROCESS_FD_PIPE_READ || file->type == PROCESS_FD_PIPE_WRITE) {
+		// A poll entry left over from a timed out poll() may be on this pipe.
+		process_poll_detach(proc);
+		if (owner->threads > 0) {
+			process_group_drop_pipe(proc, file);
+		}
+	}
+	owner->fds[fd] = NULL;
+	owner->fd_open[fd / 32] &= ~(1u << (fd % 32));
+	process_file_release(file);
+}
+
+bool process_fd_dup2(process_t *proc, int oldfd, int newfd) {
+	process_file_t *file = process_fd_get(proc, oldfd);
+	if (!file || newfd < 0) {
+		return false;
+	}
+	if (oldfd == newfd) {
+		return true;
+	}
+	return process_fd_install(proc, newfd, file);
+}
+
+bool process_fd_set_pipe(process_t *proc, int fd, pipe_t *pipe, bool writable) {
+	if (!proc || !pipe) {
+		return false;
+	}
+	process_file_t *file = process_file_create(writable ? PROCESS_FD_PIPE_WRITE : PROCESS_FD_PIPE_READ);
+	if (!file) {
+		pipe_maybe_free(pipe);
+		return false;
+	}
+	file->pipe = pipe;
+	if (writable) {
+		pipe_retain_write(pipe);
 	} else {
-		memcpy(&pipe->buffer[pipe->write_pos], src, first);
-		memcpy(pipe->buffer, src + first, len - first);
+		pipe_retain_read(pipe);
 	}
-	pipe->write_pos = (pipe->write_pos + len) % PIPE_BUFFER_SIZE;
-	pipe->count += len;
+	bool installed = process_fd_install(proc, fd, file);
+	process_file_release(file);
+	return installed;
+}
+
+bool process_fd_set_shm(process_t *proc, int fd, shm_object_t *obj) {
+	if (!proc || !obj) {
+		return false;
+	}
+	process_file_t *file = process_file_create(PROCESS_FD_SHM);
+	if (!file) {
+		shm_release(obj);
+		return false;
+	}
+	file->shm = obj;
+	bool installed = process_fd_install(proc, fd, file);
+	process_file_release(file);
+	return installed;
+}
+
+// Move the ring to a new buffer of `size` bytes, unwrapping its contents.
+static bool pipe_resize(pipe_t *pipe, uint32_t size) {
+	if (size < pipe->count) {
+		return false;
+	}
+	uint8_t *buffer = pipe_storage_alloc(size);
+	if (!buffer) {
+		return false;
+	}
+	uint32_t first = pipe->size - pipe->read_pos;
+	if (first > pipe->count) {
+		first = pipe->count;
+	}
+	memcpy(buffer, &pipe->buffer[pipe->read_pos], first);
+	memcpy(buffer + first, pipe->buffer, pipe->count - first);
+	pipe_storage_free(pipe->buffer, pipe->size);
+	pipe->buffer = buffer;
+	pipe->size = size;
+	pipe->read_pos = 0;
+	pipe->write_pos = pipe->count & (size - 1);
+	return true;
 }
 
 static int pipe_read_now(process_t *proc, pipe_t *pipe, uint32_t user_buf, uint32_t len) {
 	if (!proc || !pipe || len == 0) {
 		return 0;
 	}
-	uint32_t to_read = len;
-	if (to_read > pipe->count) {
-		to_read = pipe->count;
+	uint32_t read = 0;
+	while (read < len && pipe->count > 0) {
+		uint32_t chunk = len - read;
+		if (chunk > pipe->count) {
+			chunk = pipe->count;
+		}
+		if (chunk > pipe->size - pipe->read_pos) {
+			chunk = pipe->size - pipe->read_pos;
+		}
+		if (!page_copy_to_user(proc->page_directory, user_buf + read,
+		                       &pipe->buffer[pipe->read_pos], chunk)) {
+			return read > 0 ? (int)read : -1;
+		}
+		pipe->read_pos = (pipe->read_pos + chunk) & (pipe->size - 1);
+		pipe->count -= chunk;
+		read += chunk;
 	}
-	if (to_read == 0) {
+	return (int)read;
+}
+
+// Hand bytes straight from the writer's buffer to readers blocked on the
+// empty pipe, skipping the ring. Returns bytes delivered, -1 if the
+// writer's buffer faulted before any were.
+static int pipe_write_direct(process_t *proc, pipe_t *pipe, uint32_t user_buf, uint32_t len) {
+	if (pipe->count != 0) {
 		return 0;
 	}
-	uint8_t tmp[PIPE_BUFFER_SIZE];
-	pipe_peek(pipe, tmp, to_read);
-	if (!page_copy_to_user(proc->page_directory, user_buf, tmp, to_read)) {
-		return -1;
+	uint32_t done = 0;
+	while (done < len && !wait_queue_empty(&pipe->read_waiters)) {
+		wait_entry_t *entry = pipe->read_waiters.head;
+		process_t *reader = (process_t *)entry->data;
+		uint32_t chunk = len - done;
+		if (chunk > reader->wait_len) {
+			chunk = reader->wait_len;
+		}
+		if (!page_copy_user_to_user(reader->page_directory, reader->wait_buf,
+		                            proc->page_directory, user_buf + done, chunk)) {
+			if (!page_user_range_mapped(proc->page_directory, user_buf + done, chunk)) {
+				return done > 0 ? (int)done : -1;
+			}
+			wait_queue_remove(entry);
+			process_wait_finish(reader, -1, false);
+			continue;
+		}
+		done += chunk;
+		wait_queue_remove(entry);
+		process_wait_finish(reader, (int)chunk, true);
 	}
-	pipe_discard(pipe, to_read);
-	return (int)to_read;
+	return (int)done;
 }
 
 static int pipe_write_now(process_t *proc, pipe_t *pipe, uint32_t user_buf,
@@ -1318,117 +1817,117 @@ static int pipe_write_now(process_t *proc, pipe_t *pipe, uint32_t user_buf,
 	if (!proc || !pipe || len == 0) {
 		return 0;
 	}
-	uint32_t remaining = len;
-	uint32_t written = 0;
-	uint8_t tmp[PIPE_BUFFER_SIZE];
-	while (remaining > 0) {
-		uint32_t space = PIPE_BUFFER_SIZE - pipe->count;
+	int direct = pipe_write_direct(proc, pipe, user_buf + offset, len);
+	if (direct < 0) {
+		return -1;
+	}
+	uint32_t written = (uint32_t)direct;
+	uint32_t want = pipe->count + (len - written);
+	if (want > pipe->size && pipe->size < pipe->limit) {
+		uint32_t size = pipe->size;
+		while (size < want && size < pipe->limit) {
+			size <<= 1;
+		}
+		pipe_resize(pipe, size);
+	}
+	while (written < len) {
+		uint32_t space = pipe->size - pipe->count;
 		if (space == 0) {
 			break;
 		}
-		uint32_t chunk = remaining;
+		uint32_t chunk = len - written;
 		if (chunk > space) {
 			chunk = space;
 		}
-		if (chunk > sizeof(tmp)) {
-			chunk = sizeof(tmp);
+		if (chunk > pipe->size - pipe->write_pos) {
+			chunk = pipe->size - pipe->write_pos;
 		}
-		if (!page_copy_from_user(proc->page_directory, tmp, user_buf + offset + written, chunk)) {
+		if (!page_copy_from_user(proc->page_directory, &pipe->buffer[pipe->write_pos],
+		                         user_buf + offset + written, chunk)) {
 			return -1;
 		}
-		pipe_write_buffer(pipe, tmp, chunk);
+		pipe->write_pos = (pipe->write_pos + chunk) & (pipe->size - 1);
+		pipe->count += chunk;
 		written += chunk;
-		remaining -= chunk;
 	}
 	return (int)written;
 }
 
-static void pipe_wait_clear(process_t *proc) {
-	proc->pipe_wait = NULL;
-	proc->pipe_wait_op = PIPE_WAIT_NONE;
-	proc->pipe_wait_buf = 0;
-	proc->pipe_wait_len = 0;
-	proc->pipe_wait_done = 0;
+uint32_t pipe_set_size(pipe_t *pipe, uint32_t size) {
+	if (!pipe || size > PIPE_MAX_SIZE) {
+		return 0;
+	}
+	if (size == 0) {
+		return pipe->limit;
+	}
+	uint32_t limit = PIPE_MIN_SIZE;
+	while (limit < size) {
+		limit <<= 1;
+	}
+	if (pipe->size > limit && !pipe_resize(pipe, limit)) {
+		return 0;
+	}
+	bool grew = limit > pipe->limit;
+	pipe->limit = limit;
+	if (grew) {
+		pipe_wake_writers(pipe);
+	}
+	return limit;
 }
 
-static void pipe_complete_read(process_t *proc) {
-	if (!proc || !proc->pipe_wait || proc->pipe_wait_op != PIPE_WAIT_READ) {
-		return;
-	}
-	pipe_t *pipe = proc->pipe_wait;
+static bool pipe_read_wake(wait_entry_t *entry, void *key) {
+	(void)key;
+	process_t *proc = (process_t *)entry->data;
+	pipe_t *pipe = (pipe_t *)proc->wait_obj;
 	int result = 0;
 	if (pipe->count > 0) {
-		result = pipe_read_now(proc, pipe, proc->pipe_wait_buf, proc->pipe_wait_len);
-	} else if (pipe->writers == 0) {
-		result = 0;
-	} else {
-		return;
+		result = pipe_read_now(proc, pipe, proc->wait_buf, proc->wait_len);
+	} else if (pipe->writers != 0) {
+		return false;
 	}
+	process_wait_finish(proc, result, true);
 	if (result > 0) {
 		pipe_wake_writers(pipe);
 	}
-	proc->frame.eax = (result < 0) ? (uint32_t)-1 : (uint32_t)result;
-	pipe_wait_clear(proc);
-	proc->state = PROCESS_READY;
-	process_ready_enqueue(proc);
+	return true;
 }
 
-static void pipe_complete_write(process_t *proc) {
-	if (!proc || !proc->pipe_wait || proc->pipe_wait_op != PIPE_WAIT_WRITE) {
-		return;
-	}
-	pipe_t *pipe = proc->pipe_wait;
+static bool pipe_write_wake(wait_entry_t *entry, void *key) {
+	(void)key;
+	process_t *proc = (process_t *)entry->data;
+	pipe_t *pipe = (pipe_t *)proc->wait_obj;
 	if (pipe->readers == 0) {
-		proc->frame.eax = (uint32_t)-1;
-		pipe_wait_clear(proc);
-		proc->state = PROCESS_READY;
-		process_ready_enqueue(proc);
-		return;
+		process_wait_finish(proc, -1, false);
+		return true;
 	}
-	uint32_t remaining = proc->pipe_wait_len - proc->pipe_wait_done;
-	int wrote = pipe_write_now(proc, pipe, proc->pipe_wait_buf, remaining, proc->pipe_wait_done);
+	uint32_t remaining = proc->wait_len - proc->wait_done;
+	int wrote = pipe_write_now(proc, pipe, proc->wait_buf, remaining, proc->wait_done);
 	if (wrote < 0) {
-		proc->frame.eax = (uint32_t)-1;
-		pipe_wait_clear(proc);
-		proc->state = PROCESS_READY;
-		process_ready_enqueue(proc);
-		return;
+		process_wait_finish(proc, -1, false);
+		return true;
 	}
 	if (wrote > 0) {
 		pipe_wake_readers(pipe);
 	}
-	proc->pipe_wait_done += (uint32_t)wrote;
-	if (proc->pipe_wait_done >= proc->pipe_wait_len) {
-		proc->frame.eax = proc->pipe_wait_len;
-		pipe_wait_clear(proc);
-		proc->state = PROCESS_READY;
-		process_ready_enqueue(proc);
+	proc->wait_done += (uint32_t)wrote;
+	if (proc->wait_done < proc->wait_len) {
+		return false;
 	}
+	process_wait_finish(proc, (int)proc->wait_len, true);
+	return true;
 }
 
 static void pipe_wake_readers(pipe_t *pipe) {
-	if (!pipe) {
-		return;
-	}
-	for (process_t *proc = all_head; proc; proc = proc->all_next) {
-		if (proc->state != PROCESS_BLOCKED || proc->pipe_wait != pipe ||
-		    proc->pipe_wait_op != PIPE_WAIT_READ) {
-			continue;
-		}
-		pipe_complete_read(proc);
+	if (pipe) {
+		wake_up_all(&pipe->read_waiters);
+		wake_up_all(&pipe->poll_waiters);
 	}
 }
 
 static void pipe_wake_writers(pipe_t *pipe) {
-	if (!pipe) {
-		return;
-	}
-	for (process_t *proc = all_head; proc; proc = proc->all_next) {
-		if (proc->state != PROCESS_BLOCKED || proc->pipe_wait != pipe ||
-		    proc->pipe_wait_op != PIPE_WAIT_WRITE) {
-			continue;
-		}
-		pipe_complete_write(proc);
+	if (pipe) {
+		wake_up_all(&pipe->write_waiters);
+		wake_up_all(&pipe->poll_waiters);
 	}
 }
 
@@ -1451,13 +1950,11 @@ bool process_pipe_read(trap_frame_t *frame, process_t *proc, pipe_t *pipe,
 		*out_read = 0;
 		return true;
 	}
-	proc->pipe_wait = pipe;
-	proc->pipe_wait_op = PIPE_WAIT_READ;
-	proc->pipe_wait_buf = user_buf;
-	proc->pipe_wait_len = len;
-	proc->pipe_wait_done = 0;
-	if (process_block_and_switch(frame, proc)) {
-		pipe_wait_clear(proc);
+	proc->wait_obj = pipe;
+	proc->wait_buf = user_buf;
+	proc->wait_len = len;
+	proc->wait_done = 0;
+	if (process_block_on(frame, proc, &pipe->read_waiters, pipe_read_wake)) {
 		*out_read = -1;
 		return true;
 	}
@@ -1489,39 +1986,472 @@ bool process_pipe_write(trap_frame_t *frame, process_t *proc, pipe_t *pipe,
 		*out_written = wrote;
 		return true;
 	}
-	proc->pipe_wait = pipe;
-	proc->pipe_wait_op = PIPE_WAIT_WRITE;
-	proc->pipe_wait_buf = user_buf;
-	proc->pipe_wait_len = len;
-	proc->pipe_wait_done = (uint32_t)wrote;
-	if (process_block_and_switch(frame, proc)) {
-		pipe_wait_clear(proc);
+	proc->wait_obj = pipe;
+	proc->wait_buf = user_buf;
+	proc->wait_len = len;
+	proc->wait_done = (uint32_t)wrote;
+	if (process_block_on(frame, proc, &pipe->write_waiters, pipe_write_wake)) {
 		*out_written = -1;
 		return true;
 	}
 	return false;
 }
 
+// Terminal input. The keyboard IRQ only queues raw keys; waiting readers
+// are completed from process context (the idle loop, or the next tick that
+// interrupts user mode). Reads on a TTY fd are canonical: keys are echoed
+// and edited into a line that is handed over once Enter is pressed. Ctrl+D
+// hands the line over without a newline, so on an empty line the read
+// returns 0 (end of file). SYSCALL_GETCHAR stays raw, one key per call,
+// and leaves echo to the caller.
+#define TTY_LINE_MAX 256
+
+static wait_queue_t tty_line_waiters;
+static wait_queue_t tty_char_waiters;
+// poll() on the terminal, /dev/keyboard, /dev/mouse or /dev/input.
+static wait_queue_t input_poll_waiters;
+
+static char tty_line[TTY_LINE_MAX];
+static uint32_t tty_line_len = 0;
+static uint32_t tty_line_pos = 0;       // Bytes of a finished line already read
+static bool tty_line_done = false;
+static bool tty_ctrl_held = false;
+
+// Run queued keys through the line editor. Returns true once a line is done.
+static bool tty_line_feed(void) {
+	while (!tty_line_done && keyboard_has_input()) {
+		char c = keyboard_getchar();
+		if ((unsigned char)c == KEY_CTRL_DOWN) {
+			tty_ctrl_held = true;
+		} else if ((unsigned char)c == KEY_CTRL_UP) {
+			tty_ctrl_held = false;
+		} else if (tty_ctrl_held && (c == 'd' || c == 'D')) {
+			tty_line_done = true;
+		} else if (c == '\r' || c == '\n') {
+			tty_line[tty_line_len++] = '\n';
+			tty_line_done = true;
+			terminal_write("\n", 1);
+		} else if (c == '\b') {
+			if (tty_line_len > 0) {
+				tty_line_len--;
+				terminal_write("\b \b", 3);
+			}
+		} else if ((unsigned char)c >= 32 && (unsigned char)c < 0x7F &&
+		           tty_line_len < TTY_LINE_MAX - 1) {
+			tty_line[tty_line_len++] = c;
+			terminal_write(&c, 1);
+		}
+	}
+	return tty_line_done;
+}
+
+static int tty_line_take(process_t *proc, uint32_t user_buf, uint32_t len) {
+	uint32_t chunk = tty_line_len - tty_line_pos;
+	if (chunk > len) {
+		chunk = len;
+	}
+	if (!page_copy_to_user(proc->page_directory, user_buf, &tty_line[tty_line_pos], chunk)) {
+		return -1;
+	}
+	tty_line_pos += chunk;
+	if (tty_line_pos == tty_line_len) {
+		tty_line_len = 0;
+		tty_line_pos = 0;
+		tty_line_done = false;
+	}
+	return (int)chunk;
+}
+
+static bool tty_char_wake(wait_entry_t *entry, void *key) {
+	(void)key;
+	if (!keyboard_has_input()) {
+		return false;
+	}
+	process_wait_finish((process_t *)entry->data, (unsigned char)keyboard_getchar(), true);
+	return true;
+}
+
+static bool tty_line_wake(wait_entry_t *entry, void *key) {
+	(void)key;
+	if (!tty_line_feed()) {
+		return false;
+	}
+	process_t *proc = (process_t *)entry->data;
+	process_wait_finish(proc, tty_line_take(proc, proc->wait_buf, proc->wait_len), true);
+	return true;
+}
+
+static void process_input_run(void) {
+	while (keyboard_has_input() && wake_up_one(&tty_char_waiters)) {
+	}
+	while (wake_up_one(&tty_line_waiters)) {
+	}
+	wake_up_all(&input_poll_waiters);
+}
+
+bool process_tty_read(trap_frame_t *frame, process_t *proc, uint32_t user_buf,
+                      uint32_t len, int *out_read) {
+	if (!frame || !proc || !out_read) {
+		return true;
+	}
+	if (len == 0) {
+		*out_read = 0;
+		return true;
+	}
+	if (tty_line_feed()) {
+		*out_read = tty_line_take(proc, user_buf, len);
+		return true;
+	}
+	proc->wait_buf = user_buf;
+	proc->wait_len = len;
+	if (process_block_on(frame, proc, &tty_line_waiters, tty_line_wake)) {
+		*out_read = -1;
+		return true;
+	}
+	return false;
+}
+
+bool process_tty_getchar(trap_frame_t *frame, process_t *proc, int *out_char) {
+	if (!frame || !proc || !out_char) {
+		return true;
+	}
+	if (keyboard_has_input()) {
+		*out_char = (unsigned char)keyboard_getchar();
+		return true;
+	}
+	if (process_block_on(frame, proc, &tty_char_waiters, tty_char_wake)) {
+		*out_char = -1;
+		return true;
+	}
+	return false;
+}
+
+// poll(). A poller puts one entry on the poll queue of every object it
+// watches; those queues are woken whenever readiness may have changed and
+// the callback rescans the caller's whole pollfd array. The timeout is the
+// sleep timer, whose expiry returns 0. wait_obj points at poll_entries for
+// as long as the call is pending.
+static uint16_t poll_fd_events(process_t *proc, int32_t fd, uint16_t events,
+                               wait_queue_t **out_queue) {
+	*out_queue = NULL;
+	process_file_t *entry = process_fd_get(proc, fd);
+	if (!entry) {
+		return POLLNVAL;
+	}
+	uint16_t revents = 0;
+	switch (entry->type) {
+	case PROCESS_FD_PIPE_READ:
+		if (entry->pipe->count > 0) {
+			revents |= POLLIN;
+		}
+		if (entry->pipe->writers == 0) {
+			revents |= POLLHUP;
+		}
+		*out_queue = &entry->pipe->poll_waiters;
+		break;
+	case PROCESS_FD_PIPE_WRITE:
+		if (entry->pipe->readers == 0) {
+			revents |= POLLERR;
+		} else if (entry->pipe->count < entry->pipe->limit) {
+			revents |= POLLOUT;
+		}
+		*out_queue = &entry->pipe->poll_waiters;
+		break;
+	case PROCESS_FD_TTY:
+		if ((events & POLLIN) && tty_line_feed()) {
+			revents |= POLLIN;
+		}
+		revents |= POLLOUT;
+		*out_queue = &input_poll_waiters;
+		break;
+	case PROCESS_FD_KEYBOARD:
+		if (keyboard_has_input()) {
+			revents |= POLLIN;
+		}
+		*out_queue = &input_poll_waiters;
+		break;
+	case PROCESS_FD_MOUSE:
+		if (mouse_has_input()) {
+			revents |= POLLIN;
+		}
+		*out_queue = &input_poll_waiters;
+		break;
+	case PROCESS_FD_INPUT:
+		if (input_has_events()) {
+			revents |= POLLIN;
+		}
+		*out_queue = &input_poll_waiters;
+		break;
+	default:
+		revents = POLLIN | POLLOUT;
+		break;
+	}
+	return revents & (events | POLLERR | POLLHUP);
+}
+
+static bool poll_wake(wait_entry_t *entry, void *key);
+
+// Fill in revents for the user pollfd array and return the ready count, or
+// -1 if it cannot be accessed. With `enqueue`, also put the process on the
+// poll queue of every watched object.
+static int poll_scan(process_t *proc, uint32_t user_fds, uint32_t nfds, bool enqueue) {
+	process_pollfd_t fds[PROCESS_POLL_MAX];
+	uint32_t bytes = nfds * sizeof(process_pollfd_t);
+	if (!page_copy_from_user(proc->page_directory, fds, user_fds, bytes)) {
+		return -1;
+	}
+	int ready = 0;
+	for (uint32_t i = 0; i < nfds; i++) {
+		fds[i].revents = 0;
+		if (fds[i].fd < 0) {
+			continue;
+		}
+		wait_queue_t *queue = NULL;
+		fds[i].revents = (int16_t)poll_fd_events(proc, fds[i].fd, (uint16_t)fds[i].events, &queue);
+		if (fds[i].revents) {
+			ready++;
+		}
+		if (!enqueue || !queue) {
+			continue;
+		}
+		bool queued = false;
+		for (uint32_t j = 0; j < proc->poll_count; j++) {
+			if (proc->poll_entries[j].queue == queue) {
+				queued = true;
+				break;
+			}
+		}
+		if (!queued) {
+			wait_entry_t *poll_entry = &proc->poll_entries[proc->poll_count++];
+			wait_entry_init(poll_entry, poll_wake, proc);
+			wait_queue_add(queue, poll_entry);
+		}
+	}
+	if (!page_copy_to_user(proc->page_directory, user_fds, fds, bytes)) {
+		return -1;
+	}
+	return ready;
+}
+
+static bool poll_wake(wait_entry_t *entry, void *key) {
+	(void)key;
+	process_t *proc = (process_t *)entry->data;
+	if (proc->state != PROCESS_BLOCKED || proc->wait_obj != proc->poll_entries) {
+		return true;
+	}
+	int ready = poll_scan(proc, proc->wait_buf, proc->wait_len, false);
+	if (ready == 0) {
+		return false;
+	}
+	// The timeout fires from the timer IRQ; whoever gets here first wins.
+	uint32_t flags = wait_irq_save();
+	if (proc->state == PROCESS_BLOCKED && proc->wait_obj == proc->poll_entries) {
+		process_sleep_cancel(proc);
+		process_wait_cancel(proc);
+		process_wait_finish(proc, ready, true);
+	}
+	wait_irq_restore(flags);
+	return true;
+}
+
+bool process_poll(trap_frame_t *frame, process_t *proc, uint32_t user_fds,
+                  uint32_t nfds, int32_t timeout_ms, int *out_ready) {
+	if (!frame || !proc || !out_ready) {
+		return true;
+	}
+	// Readiness only changes in process context (or from input that is
+	// handed over there), so nothing is missed between scan and block.
+	process_poll_detach(proc);
+	int ready = poll_scan(proc, user_fds, nfds, timeout_ms != 0);
+	if (ready != 0 || timeout_ms == 0) {
+		process_wait_cancel(proc);
+		*out_ready = ready;
+		return true;
+	}
+	proc->wait_obj = proc->poll_entries;
+	proc->wait_buf = user_fds;
+	proc->wait_len = nfds;
+	if (timeout_ms > 0) {
+		ktimer_add(&proc->sleep_timer, timer_get_ms() + (uint32_t)timeout_ms);
+	}
+	if (process_block_and_switch(frame, proc)) {
+		process_sleep_cancel(proc);
+		process_wait_cancel(proc);
+		*out_ready = -1;
+		return true;
+	}
+	return false;
+}
+
 bool process_kill_other(uint32_t pid, int exit_code) {
 	process_t *target = process_find(pid);
-	if (!target || target == current_process) {
+	if (!target) {
+		return false;
+	}
+	// Killing any thread kills its process, which must not be the caller's.
+	target = process_group_leader(target);
+	if (current_process && process_group_leader(current_process) == target) {
 		return false;
 	}
+	process_end_threads(target, NULL);
+	process_kill(target, exit_code);
+	return true;
+}
+
+static void process_kill(process_t *target, int exit_code) {
 	bool had_waiter = false;
 	target->exit_code = exit_code;
-	process_wake_waiters(target, exit_code, &had_waiter);
+	process_wake_waiters(target, &had_waiter);
+	// Leave any wait queues before closing fds can free the pipes they are in.
+	process_sleep_cancel(target);
+	process_wait_cancel(target);
 	process_close_all_fds(target);
-	target->waiting = false;
-	target->wait_pid = 0;
-	target->wait_status_ptr = 0;
-	target->sleeping = false;
-	target->sleep_until = 0;
-	pipe_wait_clear(target);
 	target->state = PROCESS_ZOMBIE;
 	if (target->page_directory) {
 		page_directory_destroy(target->page_directory);
 		target->page_directory = NULL;
+		target->user_cr3 = 0;
 	}
 	process_ready_remove(target);
+}
+
+// Futexes. A private word is keyed by address space and virtual address,
+// so a copy-on-write break under a waiter cannot lose its wakeup; a word
+// in shared memory by physical address, so every process mapping it meets
+// on the same key wherever it is mapped.
+typedef struct {
+	uint32_t space;                 // Page directory, or 0 for shared memory
+	uint32_t addr;
+} futex_key_t;
+
+static bool futex_key(process_t *proc, uint32_t addr, futex_key_t *key) {
+	uint32_t phys = 0;
+	uint32_t flags = 0;
+	if ((addr & 3) || !process_user_ptr_ok(proc, addr, sizeof(uint32_t)) ||
+	    !page_translate_flags(proc->page_directory, addr, &phys, &flags)) {
+		return false;
+	}
+	if (flags & PAGE_SHARED) {
+		key->space = 0;
+		key->addr = phys;
+	} else {
+		key->space = (uint32_t)proc->page_directory;
+		key->addr = addr;
+	}
 	return true;
 }
+
+static wait_queue_t *futex_queue(const futex_key_t *key) {
+	uint32_t hash = (key->addr >> 2) ^ (key->space >> 12);
+	return &futex_queues[hash % FUTEX_BUCKETS];
+}
+
+// A waiter that timed out stays queued until it next blocks or exits, and
+// is skipped here without counting against the wake limit.
+static bool futex_wake_fn(wait_entry_t *entry, void *key) {
+	process_t *proc = (process_t *)entry->data;
+	const futex_key_t *want = (const futex_key_t *)key;
+	if (proc->state != PROCESS_BLOCKED || proc->wait_obj != futex_queue(want) ||
+	    proc->wait_buf != want->addr || proc->wait_len != want->space) {
+		return false;
+	}
+	process_sleep_cancel(proc);
+	process_wait_finish(proc, 0, false);
+	return true;
+}
+
+bool process_futex_wait(trap_frame_t *frame, process_t *proc, uint32_t addr,
+                        uint32_t expected, int32_t timeout_ms, int *out_result) {
+	if (!frame || !proc || !out_result) {
+		return true;
+	}
+	futex_key_t key;
+	uint32_t value = 0;
+	if (!futex_key(proc, addr, &key) ||
+	    !page_copy_from_user(proc->page_directory, &value, addr, sizeof(value)) ||
+	    value != expected) {
+		*out_result = -1;
+		return true;
+	}
+	if (timeout_ms == 0) {
+		*out_result = 0;
+		return true;
+	}
+	// System calls are not preempted, so no wake can slip in between the
+	// check above and queueing here.
+	wait_queue_t *queue = futex_queue(&key);
+	proc->wait_obj = queue;
+	proc->wait_buf = key.addr;
+	proc->wait_len = key.space;
+	if (timeout_ms > 0) {
+		ktimer_add(&proc->sleep_timer, timer_get_ms() + (uint32_t)timeout_ms);
+	}
+	if (process_block_on(frame, proc, queue, futex_wake_fn)) {
+		process_sleep_cancel(proc);
+		*out_result = -1;
+		return true;
+	}
+	return false;
+}
+
+int process_futex_wake(process_t *proc, uint32_t addr, uint32_t count) {
+	futex_key_t key;
+	if (!proc || !futex_key(proc, addr, &key)) {
+		return -1;
+	}
+	return (int)wake_up(futex_queue(&key), count, &key);
+}
+
+int process_thread_create(process_t *proc, uint32_t entry, uint32_t stack_top,
+                          uint32_t clear_tid) {
+	process_t *leader = process_group_leader(proc);
+	if (!leader || !leader->page_directory || leader->state == PROCESS_ZOMBIE) {
+		return -1;
+	}
+	process_t *thread = process_alloc(leader->name);
+	if (!thread) {
+		return -1;
+	}
+	thread->leader = leader;
+	leader->threads++;
+	thread->page_directory = leader->page_directory;
+	thread->user_cr3 = leader->user_cr3;
+	thread->priority = proc->priority;
+	thread->nice = proc->nice;
+	thread->time_slice = process_quantum(thread->priority);
+	thread->uid = proc->uid;
+	thread->gid = proc->gid;
+	strncpy(thread->cwd, leader->cwd, sizeof(thread->cwd) - 1);
+	thread->cwd[sizeof(thread->cwd) - 1] = '\0';
+	process_set_args(thread, leader->args, leader->args_len);
+	// The return path runs on the thread's kernel stack in this directory.
+	if (!kpti_map_kernel_pages(thread->page_directory, thread)) {
+		process_destroy(thread);
+		return -1;
+	}
+	thread->entry = entry;
+	thread->user_stack_top = stack_top;
+	thread->clear_tid = clear_tid;
+	process_setup_frame(thread);
+	process_all_add(thread);
+	thread->state = PROCESS_READY;
+	process_ready_enqueue(thread);
+	return (int)thread->pid;
+}
+
+bool process_thread_exit(trap_frame_t *frame, int code) {
+	process_t *current = current_process;
+	if (!current || !current->leader) {
+		return process_exit_current(frame, code);
+	}
+	if (current->clear_tid &&
+	    process_user_ptr_ok(current, current->clear_tid, sizeof(uint32_t))) {
+		uint32_t zero = 0;
+		page_copy_to_user(current->page_directory, current->clear_tid, &zero, sizeof(zero));
+		process_futex_wake(current, current->clear_tid, UINT32_MAX);
+	}
+	process_destroy(current);
+	// The rest of the group may all be blocked; wait for one to wake.
+	process_idle_until_ready();
+	return process_switch_after_exit(frame);
+}
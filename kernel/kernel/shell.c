@@ -14,6 +14,7 @@
 #include <kernel/ata.h>
 #include <kernel/fs.h>
 #include <kernel/kmalloc.h>
+#include <kernel/slab.h>
 #include <kernel/pagings.h>
 #include <kernel/net.h>
 #include <kernel/usermode.h>
@@ -618,7 +619,7 @@ static void input_line(char* buffer, size_t max_length) {
 		}
 		
 		if (!keyboard_has_input()) {
-			__asm__ volatile ("hlt");
+			timer_idle();
 			continue;
 		}
 		
@@ -991,7 +992,7 @@ static void command_help(const char* args) {
 	printf("\n");
 	printf("  display <mode>   - Set display mode or show info\n");
 	printf("  edit <file>      - Text editor\n");
-	printf("  mem [addr|heap]  - Heap stats or memory dump\n");
+	printf("  mem [addr|heap|slab] - Heap/slab stats or memory dump\n");
 	printf("  dma <on|off|toggle|status> - Toggle ATA DMA (saved to /etc/boot.cfg)\n");
 	printf("  netinfo          - Show network configuration\n");
 	printf("  arp              - Show ARP table\n");
@@ -1032,6 +1033,13 @@ static void command_memory(const char* args) {
 		printf("\n");
 		return;
 	}
+
+	if (strcmp(args, "slab") == 0) {
+		printf("\n");
+		kmem_cache_print_stats();
+		printf("\n");
+		return;
+	}
 	
 	// Otherwise show memory dump at address
 	unsigned int addr = parse_hex(args);
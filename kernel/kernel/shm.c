@@ -0,0 +1,197 @@
+#include <kernel/shm.h>
+#include <kernel/kmalloc.h>
+#include <kernel/pagings.h>
+#include <kernel/process.h>
+#include <kernel/slab.h>
+#include <kernel/usermode.h>
+#include <string.h>
+
+struct shm_object {
+	char name[SHM_NAME_MAX];        // Empty once unlinked, or if anonymous
+	uint32_t size;
+	uint32_t pages;
+	uint32_t *frames;               // One reference each, dropped on free
+	uint32_t refs;                  // Descriptors, plus one while named
+	struct shm_object *next;        // Named objects
+};
+
+static kmem_cache_t *shm_cache = NULL;
+static shm_object_t *named_head = NULL;
+
+static uint32_t shm_align_page(uint32_t value) {
+	return (value + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+static shm_object_t *shm_find(const char *name) {
+	for (shm_object_t *obj = named_head; obj; obj = obj->next) {
+		if (strcmp(obj->name, name) == 0) {
+			return obj;
+		}
+	}
+	return NULL;
+}
+
+static void shm_free(shm_object_t *obj) {
+	for (uint32_t i = 0; i < obj->pages; i++) {
+		frame_free(obj->frames[i]);
+	}
+	kfree(obj->frames);
+	kmem_cache_free(shm_cache, obj);
+}
+
+static shm_object_t *shm_create(const char *name, uint32_t size) {
+	if (!shm_cache) {
+		shm_cache = kmem_cache_create("shm", sizeof(shm_object_t), 0, NULL);
+		if (!shm_cache) {
+			return NULL;
+		}
+	}
+	shm_object_t *obj = (shm_object_t *)kmem_cache_alloc(shm_cache);
+	if (!obj) {
+		return NULL;
+	}
+	memset(obj, 0, sizeof(*obj));
+	obj->size = size;
+	obj->pages = shm_align_page(size) / PAGE_SIZE;
+	obj->frames = (uint32_t *)kmalloc(obj->pages * sizeof(uint32_t));
+	if (!obj->frames) {
+		kmem_cache_free(shm_cache, obj);
+		return NULL;
+	}
+	for (uint32_t i = 0; i < obj->pages; i++) {
+		uint32_t phys = frame_alloc();
+		if (!phys) {
+			obj->pages = i;
+			shm_free(obj);
+			return NULL;
+		}
+		memset(phys_to_virt(phys), 0, PAGE_SIZE);
+		obj->frames[i] = phys;
+	}
+	obj->refs = 1;
+	if (name[0] != '\0') {
+		strncpy(obj->name, name, SHM_NAME_MAX - 1);
+		obj->name[SHM_NAME_MAX - 1] = '\0';
+		obj->next = named_head;
+		named_head = obj;
+		obj->refs++;
+	}
+	return obj;
+}
+
+shm_object_t *shm_open(const char *name, uint32_t size, uint32_t flags) {
+	if (!name) {
+		return NULL;
+	}
+	if (name[0] != '\0') {
+		shm_object_t *obj = shm_find(name);
+		if (obj) {
+			if ((flags & (SHM_CREATE | SHM_EXCL)) == (SHM_CREATE | SHM_EXCL) ||
+			    size > obj->size) {
+				return NULL;
+			}
+			obj->refs++;
+			return obj;
+		}
+		if (!(flags & SHM_CREATE)) {
+			return NULL;
+		}
+	}
+	if (size == 0 || size > SHM_MAX_SIZE) {
+		return NULL;
+	}
+	return shm_create(name, size);
+}
+
+bool shm_unlink(const char *name) {
+	if (!name || name[0] == '\0') {
+		return false;
+	}
+	for (shm_object_t **link = &named_head; *link; link = &(*link)->next) {
+		shm_object_t *obj = *link;
+		if (strcmp(obj->name, name) == 0) {
+			*link = obj->next;
+			obj->next = NULL;
+			obj->name[0] = '\0';
+			shm_release(obj);
+			return true;
+		}
+	}
+	return false;
+}
+
+void shm_retain(shm_object_t *obj) {
+	if (obj) {
+		obj->refs++;
+	}
+}
+
+void shm_release(shm_object_t *obj) {
+	if (!obj || obj->refs == 0) {
+		return;
+	}
+	if (--obj->refs == 0) {
+		shm_free(obj);
+	}
+}
+
+uint32_t shm_size(const shm_object_t *obj) {
+	return obj ? obj->size : 0;
+}
+
+uint32_t shm_map(process_t *proc, shm_object_t *obj, uint32_t flags) {
+	if (!proc || !proc->page_directory || !obj) {
+		return 0;
+	}
+	// First fit over the shared memory window.
+	uint32_t span = obj->pages * PAGE_SIZE;
+	uint32_t base = USER_SHM_BASE;
+	uint32_t addr = base;
+	while (addr < USER_SHM_BASE + USER_SHM_SIZE && addr - base < span) {
+		uint32_t phys;
+		if (page_translate(proc->page_directory, addr, &phys)) {
+			base = addr + PAGE_SIZE;
+		}
+		addr += PAGE_SIZE;
+	}
+	if (addr - base < span) {
+		return 0;
+	}
+
+	uint32_t page_flags = PAGE_USER | PAGE_SHARED;
+	if (flags & SHM_MAP_WRITE) {
+		page_flags |= PAGE_RW;
+	}
+	for (uint32_t i = 0; i < obj->pages; i++) {
+		uint32_t virt = base + i * PAGE_SIZE;
+		if (!page_map(proc->page_directory, virt, obj->frames[i], page_flags)) {
+			for (uint32_t undo = 0; undo < i; undo++) {
+				page_unmap(proc->page_directory, base + undo * PAGE_SIZE, true);
+			}
+			return 0;
+		}
+		frame_ref_inc(obj->frames[i]);
+	}
+	return base;
+}
+
+bool shm_unmap(process_t *proc, uint32_t addr, uint32_t size) {
+	if (!proc || !proc->page_directory || (addr & (PAGE_SIZE - 1)) || size == 0) {
+		return false;
+	}
+	uint32_t end = addr + shm_align_page(size);
+	if (addr < USER_SHM_BASE || end > USER_SHM_BASE + USER_SHM_SIZE || end < addr) {
+		return false;
+	}
+	bool unmapped = false;
+	for (uint32_t virt = addr; virt < end; virt += PAGE_SIZE) {
+		uint32_t phys;
+		uint32_t page_flags;
+		if (page_translate_flags(proc->page_directory, virt, &phys, &page_flags) &&
+		    (page_flags & PAGE_SHARED)) {
+			page_unmap(proc->page_directory, virt, true);
+			unmapped = true;
+		}
+	}
+	return unmapped;
+}
@@ -0,0 +1,297 @@
+#include <kernel/slab.h>
+#include <kernel/kmalloc.h>
+#include <stdio.h>
+#include <string.h>
+
+// Slab layout (one kmalloc allocation per slab):
+//
+//   [kmem_slab_t][pad][slot 0][slot 1]...[slot N-1]
+//
+// Every slot starts with a small header naming the owning slab, which makes
+// kmem_cache_free O(1) without requiring slabs to be size-aligned.
+
+#define KMEM_SLAB_TARGET_SIZE 4096
+#define KMEM_SLAB_MIN_OBJECTS 4
+#define KMEM_CACHE_MAX_EMPTY_SLABS 1
+#define KMEM_MIN_ALIGN 8
+#define KMEM_SLOT_ALLOCATED ((kmem_slot_t *)0x1)
+
+typedef struct kmem_slab kmem_slab_t;
+
+typedef struct kmem_slot {
+	kmem_slab_t *slab;
+	struct kmem_slot *next_free;    // KMEM_SLOT_ALLOCATED while handed out
+} kmem_slot_t;
+
+struct kmem_slab {
+	kmem_cache_t *cache;
+	kmem_slab_t *prev;
+	kmem_slab_t *next;
+	kmem_slot_t *free_list;
+	uint32_t in_use;
+};
+
+struct kmem_cache {
+	char name[KMEM_CACHE_NAME_MAX];
+	size_t object_size;
+	size_t align;
+	size_t object_offset;           // Offset of the object inside a slot
+	size_t slot_size;
+	size_t objects_per_slab;
+	size_t slab_bytes;              // Bytes requested from kmalloc per slab
+	void (*ctor)(void *);
+	kmem_slab_t *partial;
+	kmem_slab_t *full;
+	kmem_slab_t *empty;
+	size_t slab_count;
+	size_t empty_count;
+	size_t active_objects;
+	struct kmem_cache *next;
+};
+
+static kmem_cache_t *cache_list = NULL;
+
+static inline size_t kmem_align_up(size_t value, size_t align) {
+	return (value + align - 1) & ~(align - 1);
+}
+
+static void slab_list_push(kmem_slab_t **head, kmem_slab_t *slab) {
+	slab->prev = NULL;
+	slab->next = *head;
+	if (*head) {
+		(*head)->prev = slab;
+	}
+	*head = slab;
+}
+
+static void slab_list_remove(kmem_slab_t **head, kmem_slab_t *slab) {
+	if (slab->prev) {
+		slab->prev->next = slab->next;
+	} else {
+		*head = slab->next;
+	}
+	if (slab->next) {
+		slab->next->prev = slab->prev;
+	}
+	slab->prev = NULL;
+	slab->next = NULL;
+}
+
+static inline kmem_slot_t *slot_from_object(const kmem_cache_t *cache, void *obj) {
+	return (kmem_slot_t *)((uint8_t *)obj - cache->object_offset);
+}
+
+static inline void *object_from_slot(const kmem_cache_t *cache, kmem_slot_t *slot) {
+	return (uint8_t *)slot + cache->object_offset;
+}
+
+static kmem_slab_t *kmem_slab_grow(kmem_cache_t *cache) {
+	kmem_slab_t *slab = (kmem_slab_t *)kmalloc(cache->slab_bytes);
+	if (!slab) {
+		return NULL;
+	}
+	slab->cache = cache;
+	slab->prev = NULL;
+	slab->next = NULL;
+	slab->free_list = NULL;
+	slab->in_use = 0;
+
+	uintptr_t base = kmem_align_up((uintptr_t)(slab + 1), cache->align);
+	// Build the free list back to front so slots are handed out in address order.
+	for (size_t i = cache->objects_per_slab; i > 0; i--) {
+		kmem_slot_t *slot = (kmem_slot_t *)(base + (i - 1) * cache->slot_size);
+		slot->slab = slab;
+		slot->next_free = slab->free_list;
+		slab->free_list = slot;
+		if (cache->ctor) {
+			cache->ctor(object_from_slot(cache, slot));
+		}
+	}
+
+	cache->slab_count++;
+	return slab;
+}
+
+static void kmem_slab_release(kmem_cache_t *cache, kmem_slab_t *slab) {
+	cache->slab_count--;
+	kfree(slab);
+}
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+                                void (*ctor)(void *)) {
+	if (size == 0) {
+		return NULL;
+	}
+	if (align < KMEM_MIN_ALIGN) {
+		align = KMEM_MIN_ALIGN;
+	}
+	if ((align & (align - 1)) != 0) {
+		return NULL;
+	}
+
+	kmem_cache_t *cache = (kmem_cache_t *)kcalloc(1, sizeof(kmem_cache_t));
+	if (!cache) {
+		return NULL;
+	}
+
+	if (name) {
+		strncpy(cache->name, name, sizeof(cache->name) - 1);
+	}
+	cache->name[sizeof(cache->name) - 1] = '\0';
+	cache->object_size = size;
+	cache->align = align;
+	cache->object_offset = kmem_align_up(sizeof(kmem_slot_t), align);
+	cache->slot_size = kmem_align_up(cache->object_offset + size, align);
+	cache->ctor = ctor;
+
+	size_t objects = KMEM_SLAB_TARGET_SIZE / cache->slot_size;
+	if (objects < KMEM_SLAB_MIN_OBJECTS) {
+		objects = KMEM_SLAB_MIN_OBJECTS;
+	}
+	cache->objects_per_slab = objects;
+	// Leave room to align the first slot past the slab header.
+	cache->slab_bytes = sizeof(kmem_slab_t) + (align - 1) + objects * cache->slot_size;
+
+	cache->next = cache_list;
+	cache_list = cache;
+	return cache;
+}
+
+void kmem_cache_destroy(kmem_cache_t *cache) {
+	if (!cache) {
+		return;
+	}
+	kmem_slab_t **lists[] = {&cache->partial, &cache->full, &cache->empty};
+	for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+		kmem_slab_t *slab = *lists[i];
+		while (slab) {
+			kmem_slab_t *next = slab->next;
+			kmem_slab_release(cache, slab);
+			slab = next;
+		}
+		*lists[i] = NULL;
+	}
+
+	kmem_cache_t **cursor = &cache_list;
+	while (*cursor) {
+		if (*cursor == cache) {
+			*cursor = cache->next;
+			break;
+		}
+		cursor = &(*cursor)->next;
+	}
+	kfree(cache);
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+	if (!cache) {
+		return NULL;
+	}
+
+	kmem_slab_t *slab = cache->partial;
+	if (!slab) {
+		slab = cache->empty;
+		if (slab) {
+			slab_list_remove(&cache->empty, slab);
+			cache->empty_count--;
+		} else {
+			slab = kmem_slab_grow(cache);
+			if (!slab) {
+				printf("kmem_cache_alloc: %s out of memory\n", cache->name);
+				return NULL;
+			}
+		}
+		slab_list_push(&cache->partial, slab);
+	}
+
+	kmem_slot_t *slot = slab->free_list;
+	slab->free_list = slot->next_free;
+	slot->next_free = KMEM_SLOT_ALLOCATED;
+	slab->in_use++;
+	cache->active_objects++;
+
+	if (!slab->free_list) {
+		slab_list_remove(&cache->partial, slab);
+		slab_list_push(&cache->full, slab);
+	}
+
+	return object_from_slot(cache, slot);
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj) {
+	if (!cache || !obj) {
+		return;
+	}
+
+	kmem_slot_t *slot = slot_from_object(cache, obj);
+	kmem_slab_t *slab = slot->slab;
+	if (!slab || slab->cache != cache) {
+		printf("kmem_cache_free: %s: object 0x%x not from this cache\n",
+		       cache->name, (uint32_t)obj);
+		return;
+	}
+	if (slot->next_free != KMEM_SLOT_ALLOCATED) {
+		printf("kmem_cache_free: %s: double free of 0x%x\n",
+		       cache->name, (uint32_t)obj);
+		return;
+	}
+
+	bool was_full = slab->free_list == NULL;
+	slot->next_free = slab->free_list;
+	slab->free_list = slot;
+	slab->in_use--;
+	cache->active_objects--;
+
+	if (was_full) {
+		slab_list_remove(&cache->full, slab);
+		slab_list_push(&cache->partial, slab);
+	}
+
+	if (slab->in_use == 0) {
+		slab_list_remove(&cache->partial, slab);
+		if (cache->empty_count >= KMEM_CACHE_MAX_EMPTY_SLABS) {
+			kmem_slab_release(cache, slab);
+		} else {
+			slab_list_push(&cache->empty, slab);
+			cache->empty_count++;
+		}
+	}
+}
+
+void kmem_cache_shrink(kmem_cache_t *cache) {
+	if (!cache) {
+		return;
+	}
+	kmem_slab_t *slab = cache->empty;
+	while (slab) {
+		kmem_slab_t *next = slab->next;
+		kmem_slab_release(cache, slab);
+		slab = next;
+	}
+	cache->empty = NULL;
+	cache->empty_count = 0;
+}
+
+void kmem_cache_get_stats(kmem_cache_t *cache, kmem_cache_stats_t *stats) {
+	if (!cache || !stats) {
+		return;
+	}
+	memset(stats, 0, sizeof(*stats));
+	strncpy(stats->name, cache->name, sizeof(stats->name) - 1);
+	stats->object_size = cache->object_size;
+	stats->objects_per_slab = cache->objects_per_slab;
+	stats->slabs = cache->slab_count;
+	stats->active_objects = cache->active_objects;
+	stats->total_objects = cache->slab_count * cache->objects_per_slab;
+}
+
+void kmem_cache_print_stats(void) {
+	printf("=== Slab Caches ===\n");
+	for (kmem_cache_t *cache = cache_list; cache; cache = cache->next) {
+		kmem_cache_stats_t stats;
+		kmem_cache_get_stats(cache, &stats);
+		printf("%s: %d bytes, %d per slab, %d slabs, %d/%d objects in use\n",
+		       stats.name, stats.object_size, stats.objects_per_slab,
+		       stats.slabs, stats.active_objects, stats.total_objects);
+	}
+}
@@ -5,6 +5,7 @@
 #include <kernel/elf.h>
 #include <kernel/shell.h>
 #include <kernel/timer.h>
+#include <kernel/input.h>
 #include <kernel/keyboard.h>
 #include <kernel/io.h>
 #include <kernel/speaker.h>
@@ -17,12 +18,17 @@
 #include <kernel/file_manager.h>
 #include <kernel/mouse.h>
 #include <kernel/process.h>
+#include <kernel/shm.h>
 #include <kernel/pagings.h>
+#include <kernel/usercopy.h>
+#include <kernel/gdt.h>
 #include <kernel/kmalloc.h>
 #include <kernel/user_programs.h>
 #include <string.h>
 
 volatile uint32_t syscall_exit_requested = 0;
+volatile uint32_t syscall_sysenter_frame = 0;
+volatile uint32_t syscall_sysenter_tf = 0;
 volatile uint32_t syscall_exit_code = 0;
 volatile uint32_t usermode_return_esp = 0;
 volatile uint32_t usermode_saved_ebx = 0;
@@ -34,6 +40,9 @@ volatile uint32_t usermode_abort_requested = 0;
 #define ALIAS_NAME_MAX 32
 #define ALIAS_CMD_MAX 256
 
+// SYSCALL_CLOCK_GETTIME clock ids
+#define CLOCK_MONOTONIC 1
+
 typedef struct {
 	uint32_t size;
 	uint32_t type;
@@ -63,7 +72,8 @@ typedef struct {
 	uint32_t pid;
 	uint8_t state;
 	uint8_t priority;
-	uint16_t reserved;
+	int8_t nice;
+	uint8_t reserved;
 	uint32_t time_slice;
 	uint32_t total_time;
 	char name[PROCESS_NAME_MAX];
@@ -116,6 +126,72 @@ typedef struct {
 	const uint8_t *pixels;
 } user_gfx_blit_t;
 
+// SYSCALL_GFX_SUBMIT command buffer: a packed sequence of commands, each
+// starting with a header whose size covers the whole (4-byte aligned) command.
+#define GFX_SUBMIT_MAX 4096
+
+enum {
+	GFX_CMD_CLEAR = 1,
+	GFX_CMD_PIXEL,
+	GFX_CMD_RECT,
+	GFX_CMD_FILL_RECT,
+	GFX_CMD_LINE,
+	GFX_CMD_CHAR,
+	GFX_CMD_TEXT,
+	GFX_CMD_BLIT,
+	GFX_CMD_CLIP,
+	GFX_CMD_CLIP_RESET,
+};
+
+typedef struct {
+	uint16_t op;
+	uint16_t size;
+} gfx_cmd_header_t;
+
+typedef struct {
+	gfx_cmd_header_t hdr;
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+	uint8_t color;
+	uint8_t reserved[3];
+} gfx_cmd_rect_t;
+
+typedef struct {
+	gfx_cmd_header_t hdr;
+	int32_t x1;
+	int32_t y1;
+	int32_t x2;
+	int32_t y2;
+	uint8_t color;
+	uint8_t reserved[3];
+} gfx_cmd_line_t;
+
+typedef struct {
+	gfx_cmd_header_t hdr;
+	int32_t x;
+	int32_t y;
+	uint8_t fg;
+	uint8_t bg;
+	uint16_t len;           // Text bytes that follow, no terminator
+} gfx_cmd_text_t;
+
+typedef struct {
+	gfx_cmd_header_t hdr;
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+	int32_t stride;
+	uint32_t pixels;        // User pointer, read when the command runs
+} gfx_cmd_blit_t;
+
+static uint8_t gfx_submit_buf[GFX_SUBMIT_MAX] __attribute__((aligned(4)));
+// Buttons as of the last SYSCALL_MOUSE_GET_STATE, so a held button is not
+// mistaken for fresh input on every poll.
+static uint8_t mouse_polled_buttons = 0;
+
 static bool user_range_ok(uint32_t addr, uint32_t size) {
 	if (size == 0) {
 		return true;
@@ -151,64 +227,160 @@ static bool copy_user_out(void *dst, uint32_t dst_len, const void *src, uint32_t
 	if (src_len == 0) {
 		return true;
 	}
-	if (src_len > dst_len) {
-		return false;
-	}
-	if (!dst || !src || !user_range_ok((uint32_t)dst, dst_len)) {
-		return false;
-	}
-	process_t *proc = process_current();
-	if (!proc || !proc->page_directory) {
+	if (src_len > dst_len || !dst) {
 		return false;
 	}
-	return page_copy_to_user(proc->page_directory, (uint32_t)dst, src, src_len);
+	return copy_to_user((uint32_t)dst, src, src_len);
 }
 
 static bool copy_user_in(void *dst, uint32_t dst_len, const void *src, uint32_t src_len) {
 	if (src_len == 0) {
 		return true;
 	}
-	if (src_len > dst_len) {
-		return false;
-	}
-	if (!dst || !src || !user_range_ok((uint32_t)src, src_len)) {
-		return false;
-	}
-	process_t *proc = process_current();
-	if (!proc || !proc->page_directory) {
+	if (src_len > dst_len || !src) {
 		return false;
 	}
-	return page_copy_from_user(proc->page_directory, dst, (uint32_t)src, src_len);
+	return copy_from_user(dst, (uint32_t)src, src_len);
 }
 
 static bool copy_user_string(char *dst, size_t dst_size, const char *user_ptr) {
-	if (!dst || dst_size == 0 || !user_ptr) {
+	if (!user_ptr) {
+		if (dst && dst_size > 0) {
+			dst[0] = '\0';
+		}
 		return false;
 	}
-	dst[0] = '\0';
+	return strncpy_from_user(dst, (uint32_t)user_ptr, dst_size);
+}
 
+static bool gfx_submit_blit(const gfx_cmd_blit_t *cmd) {
 	process_t *proc = process_current();
-	if (!proc || !proc->page_directory) {
+	if (!proc || !proc->page_directory || cmd->pixels == 0 ||
+	    cmd->width <= 0 || cmd->height <= 0 || cmd->stride < cmd->width) {
 		return false;
 	}
+	if (!user_range_ok_mul(cmd->pixels, (uint32_t)cmd->height, (uint32_t)cmd->stride)) {
+		return false;
+	}
+	return graphics_blit_from_user(proc->page_directory, cmd->x, cmd->y, cmd->width,
+	                               cmd->height, cmd->stride, cmd->pixels);
+}
 
-	for (size_t i = 0; i < dst_size - 1; i++) {
-		uint32_t addr = (uint32_t)(user_ptr + i);
-		if (!user_range_ok(addr, 1)) {
-			return false;
-		}
-		char c = '\0';
-		if (!page_copy_from_user(proc->page_directory, &c, addr, 1)) {
-			return false;
-		}
-		dst[i] = c;
-		if (c == '\0') {
-			return true;
+// Run a copied-in command buffer. Returns the number of commands executed,
+// or -1 if a command is malformed (earlier commands have already run).
+static int gfx_submit_run(const uint8_t *buf, uint32_t len) {
+	int count = 0;
+	uint32_t off = 0;
+	while (off < len) {
+		if (len - off < sizeof(gfx_cmd_header_t)) {
+			return -1;
+		}
+		const gfx_cmd_header_t *hdr = (const gfx_cmd_header_t *)(buf + off);
+		if (hdr->size < sizeof(*hdr) || (hdr->size & 3) != 0 || hdr->size > len - off) {
+			return -1;
+		}
+		const gfx_cmd_rect_t *rect = (const gfx_cmd_rect_t *)hdr;
+		bool has_rect = hdr->size >= sizeof(gfx_cmd_rect_t);
+		switch (hdr->op) {
+			case GFX_CMD_CLEAR:
+				if (!has_rect) {
+					return -1;
+				}
+				graphics_clear(rect->color);
+				break;
+			case GFX_CMD_PIXEL:
+				if (!has_rect) {
+					return -1;
+				}
+				graphics_putpixel(rect->x, rect->y, rect->color);
+				break;
+			case GFX_CMD_RECT:
+				if (!has_rect) {
+					return -1;
+				}
+				graphics_draw_rect(rect->x, rect->y, rect->width, rect->height, rect->color);
+				break;
+			case GFX_CMD_FILL_RECT:
+				if (!has_rect) {
+					return -1;
+				}
+				graphics_fill_rect(rect->x, rect->y, rect->width, rect->height, rect->color);
+				break;
+			case GFX_CMD_LINE: {
+				const gfx_cmd_line_t *line = (const gfx_cmd_line_t *)hdr;
+				if (hdr->size < sizeof(*line)) {
+					return -1;
+				}
+				graphics_draw_line(line->x1, line->y1, line->x2, line->y2, line->color);
+				break;
+			}
+			case GFX_CMD_CHAR:
+			case GFX_CMD_TEXT: {
+				const gfx_cmd_text_t *text = (const gfx_cmd_text_t *)hdr;
+				if (hdr->size < sizeof(*text) || text->len > hdr->size - sizeof(*text)) {
+					return -1;
+				}
+				const char *chars = (const char *)(text + 1);
+				int cx = text->x;
+				int cy = text->y;
+				for (uint16_t i = 0; i < text->len; i++) {
+					if (hdr->op == GFX_CMD_TEXT && chars[i] == '\n') {
+						cx = text->x;
+						cy += 8;
+						continue;
+					}
+					graphics_draw_char(cx, cy, chars[i], text->fg, text->bg);
+					cx += 8;
+					if (hdr->op == GFX_CMD_TEXT && cx >= graphics_get_width()) {
+						cx = text->x;
+						cy += 8;
+					}
+				}
+				break;
+			}
+			case GFX_CMD_BLIT: {
+				const gfx_cmd_blit_t *blit = (const gfx_cmd_blit_t *)hdr;
+				if (hdr->size < sizeof(*blit) || !gfx_submit_blit(blit)) {
+					return -1;
+				}
+				break;
+			}
+			case GFX_CMD_CLIP:
+				if (!has_rect) {
+					return -1;
+				}
+				graphics_set_clip(rect->x, rect->y, rect->width, rect->height);
+				break;
+			case GFX_CMD_CLIP_RESET:
+				graphics_reset_clip();
+				break;
+			default:
+				return -1;
 		}
+		off += hdr->size;
+		count++;
 	}
+	return count;
+}
 
-	dst[dst_size - 1] = '\0';
-	return false;
+// A frame can leave through SYSEXIT only if it is the frame sysenter_stub
+// built, since SYSEXIT clobbers ECX/EDX and does not restore EFLAGS. The stub
+// sets syscall_sysenter_frame and anything that loads another frame (exec,
+// a switch to another process) clears it, so those go back through iret.
+uint32_t syscall_sysexit_ok(const syscall_frame_t *frame) {
+	bool from_sysenter = syscall_sysenter_frame != 0;
+	syscall_sysenter_frame = 0;
+	if (!from_sysenter || !sysenter_enabled() || !frame) {
+		return 0;
+	}
+	if (frame->cs != GDT_USER_CODE || frame->userss != GDT_USER_DATA) {
+		return 0;
+	}
+	// TF, NT, and VM need the full iret semantics.
+	if (frame->eflags & ((1u << 8) | (1u << 14) | (1u << 17))) {
+		return 0;
+	}
+	return 1;
 }
 
 static process_t *syscall_require_process(syscall_frame_t *frame) {
@@ -244,8 +416,8 @@ void syscall_dispatch(syscall_frame_t *frame) {
 				break;
 			}
 
-			process_fd_t *out = &proc->fds[1];
-			if (!out->used || out->type == PROCESS_FD_TTY || out->type == PROCESS_FD_NONE) {
+			process_file_t *out = process_fd_get(proc, 1);
+			if (!out || out->type == PROCESS_FD_TTY) {
 				uint32_t remaining = len;
 				uint32_t offset = 0;
 				char tmp[256];
@@ -290,38 +462,21 @@ void syscall_dispatch(syscall_frame_t *frame) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
-			fs_inode_t inode;
-			if (!fs_stat(path, &inode) || inode.type != 1) {
-				frame->eax = (uint32_t)-1;
-				break;
-			}
-			int fd = -1;
-			for (int i = 0; i < PROCESS_MAX_FDS; i++) {
-				if (!proc->fds[i].used) {
-					fd = i;
-					proc->fds[i].used = true;
-					proc->fds[i].type = PROCESS_FD_FILE;
-					proc->fds[i].offset = 0;
-					strncpy(proc->fds[i].path, path, sizeof(proc->fds[i].path) - 1);
-					proc->fds[i].path[sizeof(proc->fds[i].path) - 1] = '\0';
-					proc->fds[i].pipe = NULL;
+			uint8_t type = PROCESS_FD_FILE;
+			if (strcmp(path, "/dev/mouse") == 0) {
+				type = PROCESS_FD_MOUSE;
+			} else if (strcmp(path, "/dev/keyboard") == 0) {
+				type = PROCESS_FD_KEYBOARD;
+			} else if (strcmp(path, "/dev/input") == 0) {
+				type = PROCESS_FD_INPUT;
+			} else {
+				fs_inode_t inode;
+				if (!fs_stat(path, &inode) || inode.type != 1) {
+					frame->eax = (uint32_t)-1;
 					break;
 				}
 			}
-			if (fd < 0) {
-				for (int i = 0; i < PROCESS_MAX_FDS; i++) {
-					if (proc->fds[i].used && proc->fds[i].type == PROCESS_FD_NONE) {
-						fd = i;
-						proc->fds[i].used = true;
-						proc->fds[i].type = PROCESS_FD_FILE;
-						proc->fds[i].offset = 0;
-						strncpy(proc->fds[i].path, path, sizeof(proc->fds[i].path) - 1);
-						proc->fds[i].path[sizeof(proc->fds[i].path) - 1] = '\0';
-						proc->fds[i].pipe = NULL;
-						break;
-					}
-				}
-			}
+			int fd = process_fd_open(proc, type, path);
 			frame->eax = (fd >= 0) ? (uint32_t)fd : (uint32_t)-1;
 			break;
 		}
@@ -330,10 +485,10 @@ void syscall_dispatch(syscall_frame_t *frame) {
 			if (!proc) {
 				break;
 			}
-			uint32_t fd = frame->ebx;
+			process_file_t *entry = process_fd_get(proc, (int)frame->ebx);
 			uint8_t *buf = (uint8_t *)frame->ecx;
 			uint32_t len = frame->edx;
-			if (fd >= PROCESS_MAX_FDS || !proc->fds[fd].used || len == 0) {
+			if (!entry || len == 0) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
@@ -341,7 +496,6 @@ void syscall_dispatch(syscall_frame_t *frame) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
-			process_fd_t *entry = &proc->fds[fd];
 			if (entry->type == PROCESS_FD_PIPE_READ) {
 				int read = 0;
 				if (!process_pipe_read(frame, proc, entry->pipe, (uint32_t)buf, len, &read)) {
@@ -351,31 +505,54 @@ void syscall_dispatch(syscall_frame_t *frame) {
 				break;
 			}
 			if (entry->type == PROCESS_FD_TTY) {
-				uint32_t total = 0;
-				uint8_t tmp[64];
-				while (total < len) {
-					while (!keyboard_has_input()) {
-						__asm__ volatile ("hlt");
-					}
-					uint32_t chunk = 0;
-					while (chunk < sizeof(tmp) && total + chunk < len && keyboard_has_input()) {
-						tmp[chunk++] = (uint8_t)keyboard_getchar();
-					}
-					if (chunk == 0) {
-						break;
-					}
-					if (!copy_user_out(buf + total, chunk, tmp, chunk)) {
-						frame->eax = (uint32_t)-1;
-						break;
-					}
-					total += chunk;
-					if (!keyboard_has_input()) {
-						break;
-					}
+				int read = 0;
+				if (!process_tty_read(frame, proc, (uint32_t)buf, len, &read)) {
+					break;
 				}
-				if (frame->eax != (uint32_t)-1) {
-					frame->eax = total;
+				frame->eax = (read < 0) ? (uint32_t)-1 : (uint32_t)read;
+				break;
+			}
+			if (entry->type == PROCESS_FD_MOUSE) {
+				mouse_state_t state = mouse_get_state();
+				if (len < sizeof(state) || !copy_user_out(buf, len, &state, sizeof(state))) {
+					frame->eax = (uint32_t)-1;
+					break;
 				}
+				frame->eax = sizeof(state);
+				break;
+			}
+			if (entry->type == PROCESS_FD_KEYBOARD) {
+				// Never blocks; poll for POLLIN first.
+				uint8_t keys[64];
+				uint32_t count = 0;
+				while (count < len && count < sizeof(keys) && keyboard_has_input()) {
+					keys[count++] = (uint8_t)keyboard_getchar();
+				}
+				if (count > 0 && !copy_user_out(buf, len, keys, count)) {
+					frame->eax = (uint32_t)-1;
+					break;
+				}
+				frame->eax = count;
+				break;
+			}
+			if (entry->type == PROCESS_FD_INPUT) {
+				// Whole events only; never blocks, poll for POLLIN first.
+				input_event_t events[32];
+				uint32_t max = len / sizeof(input_event_t);
+				if (max == 0) {
+					frame->eax = (uint32_t)-1;
+					break;
+				}
+				if (max > sizeof(events) / sizeof(events[0])) {
+					max = sizeof(events) / sizeof(events[0]);
+				}
+				uint32_t count = input_read(events, max);
+				uint32_t bytes = count * sizeof(input_event_t);
+				if (count > 0 && !copy_user_out(buf, len, events, bytes)) {
+					frame->eax = (uint32_t)-1;
+					break;
+				}
+				frame->eax = bytes;
 				break;
 			}
 			if (entry->type != PROCESS_FD_FILE) {
@@ -420,12 +597,12 @@ void syscall_dispatch(syscall_frame_t *frame) {
 			if (!proc) {
 				break;
 			}
-			uint32_t fd = frame->ebx;
-			if (fd >= PROCESS_MAX_FDS || !proc->fds[fd].used) {
+			int fd = (int)frame->ebx;
+			if (!process_fd_get(proc, fd)) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
-			process_fd_close(proc, (int)fd);
+			process_fd_close(proc, fd);
 			frame->eax = 0;
 			break;
 		}
@@ -468,25 +645,24 @@ void syscall_dispatch(syscall_frame_t *frame) {
 			if (!proc) {
 				break;
 			}
-			uint32_t fd = frame->ebx;
+			process_file_t *file = process_fd_get(proc, (int)frame->ebx);
 			int32_t offset = (int32_t)frame->ecx;
 			uint32_t whence = frame->edx;
 
-			if (fd >= PROCESS_MAX_FDS || !proc->fds[fd].used ||
-			    proc->fds[fd].type != PROCESS_FD_FILE) {
+			if (!file || file->type != PROCESS_FD_FILE) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
 
 			fs_inode_t inode;
-			if (!fs_stat(proc->fds[fd].path, &inode)) {
+			if (!fs_stat(file->path, &inode)) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
 
 			int32_t base = 0;
 			if (whence == 1) {
-				base = (int32_t)proc->fds[fd].offset;
+				base = (int32_t)file->offset;
 			} else if (whence == 2) {
 				base = (int32_t)inode.size;
 			} else if (whence != 0) {
@@ -500,7 +676,7 @@ void syscall_dispatch(syscall_frame_t *frame) {
 				break;
 			}
 
-			proc->fds[fd].offset = (uint32_t)new_off;
+			file->offset = (uint32_t)new_off;
 			frame->eax = (uint32_t)new_off;
 			break;
 		}
@@ -753,15 +929,39 @@ void syscall_dispatch(syscall_frame_t *frame) {
 			frame->eax = timer_get_ticks();
 			break;
 		}
+		case SYSCALL_CLOCK_GETTIME: {
+			// Writes nanoseconds since boot to ecx. Returns the address of the
+			// read-only vclock page, or 0 if the process must keep asking.
+			if (frame->ebx != CLOCK_MONOTONIC) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			uint64_t ns = timer_get_ns();
+			if (!copy_user_out((void *)frame->ecx, sizeof(ns), &ns, sizeof(ns))) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			process_t *proc = process_current();
+			bool mapped = proc && proc->page_directory &&
+			              page_translate(proc->page_directory, USER_VCLOCK_BASE, NULL);
+			frame->eax = mapped ? USER_VCLOCK_BASE : 0;
+			break;
+		}
 		case SYSCALL_GET_COMMAND_COUNT: {
 			frame->eax = shell_command_count();
 			break;
 		}
 		case SYSCALL_GETCHAR: {
-			while (!keyboard_has_input()) {
-				__asm__ volatile ("hlt");
+			process_t *proc = syscall_require_process(frame);
+			if (!proc) {
+				break;
 			}
-			frame->eax = (uint32_t)(unsigned char)keyboard_getchar();
+			int c = 0;
+			if (!process_tty_getchar(frame, proc, &c)) {
+				break;
+			}
+			frame->eax = (uint32_t)c;
+			process_boost(proc);
 			break;
 		}
 		case SYSCALL_SLEEP_MS: {
@@ -770,11 +970,7 @@ void syscall_dispatch(syscall_frame_t *frame) {
 				frame->eax = 0;
 				break;
 			}
-			uint32_t ticks = (ms * 100) / 1000;
-			if (ticks == 0 && ms > 0) {
-				ticks = 1;
-			}
-			uint32_t wake = timer_get_ticks() + ticks;
+			uint32_t wake = timer_get_ms() + ms;
 			if (process_sleep_until(frame, wake)) {
 				timer_sleep_ms(ms);
 				frame->eax = 0;
@@ -941,6 +1137,10 @@ void syscall_dispatch(syscall_frame_t *frame) {
 			frame->eax = audio_is_ready() ? 1u : 0u;
 			break;
 		}
+		case SYSCALL_FAST_ENTRY: {
+			frame->eax = sysenter_enabled() ? 1u : 0u;
+			break;
+		}
 		case SYSCALL_FS_FREE_BLOCKS: {
 			frame->eax = fs_get_free_blocks();
 			break;
@@ -998,6 +1198,7 @@ void syscall_dispatch(syscall_frame_t *frame) {
 				temp.pid = list[i].pid;
 				temp.state = list[i].state;
 				temp.priority = list[i].priority;
+				temp.nice = list[i].nice;
 				temp.time_slice = list[i].time_slice;
 				temp.total_time = list[i].total_time;
 				strncpy(temp.name, list[i].name, PROCESS_NAME_MAX - 1);
@@ -1048,33 +1249,18 @@ void syscall_dispatch(syscall_frame_t *frame) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
-			int fd_read = -1;
-			int fd_write = -1;
-			for (int i = 0; i < PROCESS_MAX_FDS; i++) {
-				if (!proc->fds[i].used) {
-					fd_read = i;
-					break;
-				}
-			}
-			if (fd_read >= 0) {
-				for (int i = fd_read + 1; i < PROCESS_MAX_FDS; i++) {
-					if (!proc->fds[i].used) {
-						fd_write = i;
-						break;
-					}
-				}
-			}
-			if (fd_read < 0 || fd_write < 0) {
+			int fd_read = process_fd_alloc(proc);
+			pipe_t *pipe = (fd_read >= 0) ? pipe_create() : NULL;
+			if (!pipe || !process_fd_set_pipe(proc, fd_read, pipe, false)) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
-			pipe_t *pipe = pipe_create();
-			if (!pipe) {
+			int fd_write = process_fd_alloc(proc);
+			if (fd_write < 0 || !process_fd_set_pipe(proc, fd_write, pipe, true)) {
+				process_fd_close(proc, fd_read);
 				frame->eax = (uint32_t)-1;
 				break;
 			}
-			process_fd_set_pipe(proc, fd_read, pipe, false);
-			process_fd_set_pipe(proc, fd_write, pipe, true);
 			int tmp[2] = {fd_read, fd_write};
 			if (!copy_user_out(fds, sizeof(tmp), tmp, sizeof(tmp))) {
 				process_fd_close(proc, fd_read);
@@ -1085,33 +1271,155 @@ void syscall_dispatch(syscall_frame_t *frame) {
 			frame->eax = 0;
 			break;
 		}
-		case SYSCALL_DUP2: {
+		case SYSCALL_PIPE_SIZE: {
+			// ebx = pipe fd, ecx = new capacity in bytes (0 to query).
 			process_t *proc = syscall_require_process(frame);
 			if (!proc) {
 				break;
 			}
-			int oldfd = (int)frame->ebx;
-			int newfd = (int)frame->ecx;
-			if (oldfd < 0 || oldfd >= PROCESS_MAX_FDS ||
-			    newfd < 0 || newfd >= PROCESS_MAX_FDS) {
+			process_file_t *file = process_fd_get(proc, (int)frame->ebx);
+			if (!file || (file->type != PROCESS_FD_PIPE_READ &&
+			              file->type != PROCESS_FD_PIPE_WRITE)) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			uint32_t size = pipe_set_size(file->pipe, frame->ecx);
+			frame->eax = size ? size : (uint32_t)-1;
+			break;
+		}
+		case SYSCALL_POLL: {
+			// ebx = struct pollfd array, ecx = count, edx = timeout in ms
+			// (-1 waits forever, 0 returns at once).
+			process_t *proc = syscall_require_process(frame);
+			if (!proc) {
+				break;
+			}
+			uint32_t nfds = frame->ecx;
+			if (nfds > PROCESS_POLL_MAX ||
+			    (nfds > 0 && !user_range_ok_mul(frame->ebx, nfds, sizeof(process_pollfd_t)))) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			int ready = 0;
+			if (!process_poll(frame, proc, frame->ebx, nfds, (int32_t)frame->edx, &ready)) {
+				break;
+			}
+			frame->eax = (ready < 0) ? (uint32_t)-1 : (uint32_t)ready;
+			break;
+		}
+		case SYSCALL_SHM_OPEN: {
+			// ebx = name (NULL for an anonymous object), ecx = size when
+			// creating, edx = SHM_CREATE/SHM_EXCL. Returns a descriptor.
+			process_t *proc = syscall_require_process(frame);
+			if (!proc) {
+				break;
+			}
+			char name[SHM_NAME_MAX];
+			name[0] = '\0';
+			if (frame->ebx && !copy_user_string(name, sizeof(name), (const char *)frame->ebx)) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
-			if (!proc->fds[oldfd].used) {
+			int fd = process_fd_alloc(proc);
+			shm_object_t *obj = (fd >= 0) ? shm_open(name, frame->ecx, frame->edx) : NULL;
+			if (!obj || !process_fd_set_shm(proc, fd, obj)) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			frame->eax = (uint32_t)fd;
+			break;
+		}
+		case SYSCALL_SHM_MAP: {
+			// ebx = shared memory fd, ecx = SHM_MAP_WRITE. Returns the address.
+			process_t *proc = syscall_require_process(frame);
+			if (!proc) {
+				break;
+			}
+			process_file_t *file = process_fd_get(proc, (int)frame->ebx);
+			if (!file || file->type != PROCESS_FD_SHM) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
-			if (oldfd == newfd) {
-				frame->eax = (uint32_t)newfd;
+			uint32_t addr = shm_map(proc, file->shm, frame->ecx);
+			frame->eax = addr ? addr : (uint32_t)-1;
+			break;
+		}
+		case SYSCALL_SHM_UNMAP: {
+			process_t *proc = syscall_require_process(frame);
+			if (!proc) {
 				break;
 			}
-			process_fd_close(proc, newfd);
-			proc->fds[newfd] = proc->fds[oldfd];
-			proc->fds[newfd].used = true;
-			if (proc->fds[newfd].type == PROCESS_FD_PIPE_READ) {
-				pipe_retain_read(proc->fds[newfd].pipe);
-			} else if (proc->fds[newfd].type == PROCESS_FD_PIPE_WRITE) {
-				pipe_retain_write(proc->fds[newfd].pipe);
+			frame->eax = shm_unmap(proc, frame->ebx, frame->ecx) ? 0 : (uint32_t)-1;
+			break;
+		}
+		case SYSCALL_SHM_UNLINK: {
+			char name[SHM_NAME_MAX];
+			if (!copy_user_string(name, sizeof(name), (const char *)frame->ebx)) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			frame->eax = shm_unlink(name) ? 0 : (uint32_t)-1;
+			break;
+		}
+		case SYSCALL_THREAD_CREATE: {
+			// ebx = entry point, ecx = initial user stack pointer, edx =
+			// word to zero and futex-wake when the thread exits (0 for none).
+			// Returns the new thread's pid.
+			process_t *proc = syscall_require_process(frame);
+			if (!proc) {
+				break;
+			}
+			if (!user_range_ok(frame->ebx, 1) || !user_range_ok(frame->ecx - 4, 4) ||
+			    (frame->edx != 0 && !user_range_ok(frame->edx, sizeof(uint32_t)))) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			int tid = process_thread_create(proc, frame->ebx, frame->ecx, frame->edx);
+			frame->eax = (tid >= 0) ? (uint32_t)tid : (uint32_t)-1;
+			break;
+		}
+		case SYSCALL_THREAD_EXIT:
+			if (!process_thread_exit(frame, (int)frame->ebx)) {
+				syscall_exit_code = frame->ebx;
+				syscall_exit_requested = 1;
+			}
+			break;
+		case SYSCALL_FUTEX_WAIT: {
+			// ebx = word, ecx = expected value, edx = timeout in ms (-1
+			// waits forever). Returns -1 at once if the word has changed.
+			process_t *proc = syscall_require_process(frame);
+			if (!proc) {
+				break;
+			}
+			int result = 0;
+			if (!process_futex_wait(frame, proc, frame->ebx, frame->ecx,
+			                        (int32_t)frame->edx, &result)) {
+				break;
+			}
+			frame->eax = (result < 0) ? (uint32_t)-1 : (uint32_t)result;
+			break;
+		}
+		case SYSCALL_FUTEX_WAKE: {
+			// ebx = word, ecx = most waiters to wake. Returns how many woke.
+			process_t *proc = syscall_require_process(frame);
+			if (!proc) {
+				break;
+			}
+			int woken = process_futex_wake(proc, frame->ebx, frame->ecx);
+			frame->eax = (woken < 0) ? (uint32_t)-1 : (uint32_t)woken;
+			break;
+		}
+		case SYSCALL_DUP2: {
+			process_t *proc = syscall_require_process(frame);
+			if (!proc) {
+				break;
+			}
+			int oldfd = (int)frame->ebx;
+			int newfd = (int)frame->ecx;
+			if (oldfd < 0 || newfd < 0 || newfd >= PROCESS_FD_LIMIT ||
+			    !process_fd_dup2(proc, oldfd, newfd)) {
+				frame->eax = (uint32_t)-1;
+				break;
 			}
 			frame->eax = (uint32_t)newfd;
 			break;
@@ -1128,7 +1436,7 @@ void syscall_dispatch(syscall_frame_t *frame) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
-			if (proc->pid == pid) {
+			if (process_group_leader(proc)->pid == pid) {
 				if (!process_exit_current(frame, exit_code)) {
 					syscall_exit_code = exit_code;
 					syscall_exit_requested = 1;
@@ -1138,6 +1446,18 @@ void syscall_dispatch(syscall_frame_t *frame) {
 			frame->eax = process_kill_other(pid, exit_code) ? 0 : (uint32_t)-1;
 			break;
 		}
+		case SYSCALL_NICE: {
+			// ebx = pid (0 for the caller), ecx = signed increment. Returns
+			// the new nice value offset by -PROCESS_NICE_MIN, so it is never
+			// negative, or -1 if there is no such process.
+			int nice = 0;
+			if (!process_renice(frame->ebx, (int)frame->ecx, &nice)) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			frame->eax = (uint32_t)(nice - PROCESS_NICE_MIN);
+			break;
+		}
 		case SYSCALL_HALT: {
 			shell_halt();
 			frame->eax = 0;
@@ -1335,6 +1655,42 @@ void syscall_dispatch(syscall_frame_t *frame) {
 			frame->eax = 0;
 			break;
 		}
+		case SYSCALL_GFX_MAP_SURFACE: {
+			// Map a width * height byte surface for the current mode; the
+			// process draws into it directly and calls SYSCALL_GFX_PRESENT.
+			process_t *proc = process_current();
+			uint32_t size = (uint32_t)(graphics_get_width() * graphics_get_height());
+			if (!proc || graphics_get_mode() == MODE_TEXT || !process_map_surface(proc, size)) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			frame->eax = USER_SURFACE_BASE;
+			break;
+		}
+		case SYSCALL_GFX_PRESENT: {
+			process_t *proc = process_current();
+			uint32_t size = (uint32_t)(graphics_get_width() * graphics_get_height());
+			if (!proc || proc->surface_size < size ||
+			    !graphics_present_from_user(proc->page_directory, USER_SURFACE_BASE)) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			frame->eax = 0;
+			break;
+		}
+		case SYSCALL_GFX_SUBMIT: {
+			uint32_t len = frame->ecx;
+			if (len > GFX_SUBMIT_MAX ||
+			    !copy_user_in(gfx_submit_buf, sizeof(gfx_submit_buf), (const void *)frame->ebx, len)) {
+				frame->eax = (uint32_t)-1;
+				break;
+			}
+			// The clip rectangle only lives for one batch.
+			int count = gfx_submit_run(gfx_submit_buf, len);
+			graphics_reset_clip();
+			frame->eax = (uint32_t)count;
+			break;
+		}
 		case SYSCALL_GFX_DOUBLEBUFFER_ENABLE: {
 			graphics_enable_double_buffer();
 			frame->eax = 0;
@@ -1351,6 +1707,10 @@ void syscall_dispatch(syscall_frame_t *frame) {
 				frame->eax = (uint32_t)-1;
 				break;
 			}
+			if (state.x || state.y || state.scroll || state.buttons != mouse_polled_buttons) {
+				process_boost(process_current());
+			}
+			mouse_polled_buttons = state.buttons;
 			frame->eax = 0;
 			break;
 		}
@@ -1414,6 +1774,7 @@ void syscall_dispatch(syscall_frame_t *frame) {
 			memcpy(frame, &proc->frame, sizeof(*frame));
 			frame->esp = kernel_esp;
 			frame->eax = 0;
+			syscall_sysenter_frame = 0;
 			break;
 		}
 		case SYSCALL_GETARGS: {
@@ -2,6 +2,7 @@
 #include <kernel/tty.h>
 #include <kernel/memory.h>
 #include <kernel/pagings.h>
+#include <kernel/timer.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -12,16 +13,13 @@ static task_t *ready_queue_head = NULL;
 static uint32_t next_task_id = 1;
 static bool task_scheduler_enabled = false;
 
-// Timer tick counter
-static uint32_t system_ticks = 0;
-
 // Time quantum for round-robin scheduling (in timer ticks)
 #define TIME_QUANTUM 5
 
 // Guard-paged kernel stacks for tasks (guard + stack pages).
 #define TASK_STACK_PAGES ((TASK_KERNEL_STACK_SIZE + PAGE_SIZE - 1) / PAGE_SIZE)
 #define TASK_STACK_SLOT_SIZE ((TASK_STACK_PAGES + 1) * PAGE_SIZE)
-#define KERNEL_STACK_BASE (KERNEL_VIRT_BASE + USER_SPACE_START)
+#define KERNEL_STACK_BASE KERNEL_STACK_REGION_BASE
 #define PROCESS_STACK_REGION_SIZE (2 * PAGE_SIZE * 128)
 #define TASK_STACK_BASE (KERNEL_STACK_BASE + PROCESS_STACK_REGION_SIZE)
 #define TASK_STACK_SLOTS MAX_TASKS
@@ -46,21 +44,23 @@ static bool ticks_reached(uint32_t now, uint32_t target) {
     return (int32_t)(now - target) >= 0;
 }
 
-static void wake_sleeping_tasks(uint32_t now) {
-    for (int i = 0; i < MAX_TASKS; i++) {
-        task_t *task = &tasks[i];
-        if (task->state != TASK_BLOCKED || !task->sleeping) {
-            continue;
-        }
-        if (!ticks_reached(now, task->sleep_until)) {
-            continue;
-        }
-        task->sleeping = false;
-        task->sleep_until = 0;
-        task->state = TASK_READY;
-        task->time_slice = TIME_QUANTUM;
-        enqueue_task(task);
+static void task_sleep_expired(ktimer_t *timer, void *data) {
+    (void)timer;
+    task_t *task = (task_t *)data;
+    if (task->state != TASK_BLOCKED || !task->sleeping) {
+        return;
     }
+    task->sleeping = false;
+    task->sleep_until = 0;
+    task->state = TASK_READY;
+    task->time_slice = TIME_QUANTUM;
+    enqueue_task(task);
+}
+
+static void task_sleep_cancel(task_t *task) {
+    ktimer_cancel(&task->sleep_timer);
+    task->sleeping = false;
+    task->sleep_until = 0;
 }
 
 // Allocate a kernel stack
@@ -177,7 +177,6 @@ void task_scheduler_init(void) {
     current_task = NULL;
     ready_queue_head = NULL;
     next_task_id = 1;
-    system_ticks = 0;
     
     // Create idle task (task ID 0 - runs when nothing else can run)
     // For now, we'll handle this implicitly
@@ -215,6 +214,7 @@ task_t* task_create(const char *name, void (*entry_point)(void), uint32_t priori
     task->kernel_stack = stack_top;
     task->page_directory = NULL; // For now, all tasks share kernel space
     task->next = NULL;
+    ktimer_init(&task->sleep_timer, task_sleep_expired, task);
     
     // Initialize registers for new task
     memset(&task->regs, 0, sizeof(registers_t));
@@ -261,8 +261,7 @@ void task_exit(void) {
     printf("KThread %u '%s' terminated\n", current_task->id, current_task->name);
     
     current_task->state = TASK_TERMINATED;
-    current_task->sleeping = false;
-    current_task->sleep_until = 0;
+    task_sleep_cancel(current_task);
     free_kernel_stack(current_task->kernel_stack);
     
     // Force a context switch
@@ -332,45 +331,50 @@ void task_unblock(task_t *task) {
     }
     
     task->state = TASK_READY;
-    task->sleeping = false;
-    task->sleep_until = 0;
+    task_sleep_cancel(task);
     task->time_slice = TIME_QUANTUM;
     enqueue_task(task);
 }
 
 // Sleep for specified ticks
 void task_sleep(uint32_t ticks) {
+    task_sleep_ms(ticks * TIMER_TICK_MS);
+}
+
+void task_sleep_ms(uint32_t ms) {
     if (!current_task) {
         return;
     }
 
-    if (ticks == 0) {
+    if (ms == 0) {
         task_yield();
         return;
     }
 
+    uint32_t wake = timer_get_ms() + ms;
     if (!ready_queue_head) {
-        uint32_t wake = system_ticks + ticks;
-        while (!ticks_reached(system_ticks, wake)) {
-            __asm__ volatile ("hlt");
+        // Nothing else to run: idle here, the timer just ends timer_idle().
+        ktimer_add(&current_task->sleep_timer, wake);
+        while (!ticks_reached(timer_get_ms(), wake)) {
+            timer_idle();
         }
+        ktimer_cancel(&current_task->sleep_timer);
         return;
     }
 
     current_task->sleeping = true;
-    current_task->sleep_until = system_ticks + ticks;
+    current_task->sleep_until = wake;
     current_task->state = TASK_BLOCKED;
+    ktimer_add(&current_task->sleep_timer, wake);
     task_yield();
 }
 
+bool task_ready_any(void) {
+    return ready_queue_head != NULL;
+}
+
 // Scheduler tick (called by timer interrupt)
 void task_scheduler_tick(void) {
-    system_ticks++;
-    
-    if (task_scheduler_enabled) {
-        wake_sleeping_tasks(system_ticks);
-    }
-
     if (!task_scheduler_enabled || !current_task) {
         return;
     }
@@ -422,8 +426,7 @@ bool task_kill(uint32_t id) {
         task_exit();
     } else {
         task->state = TASK_TERMINATED;
-        task->sleeping = false;
-        task->sleep_until = 0;
+        task_sleep_cancel(task);
         free_kernel_stack(task->kernel_stack);
         printf("KThread %u '%s' killed\n", task->id, task->name);
     }
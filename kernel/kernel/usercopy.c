@@ -0,0 +1,122 @@
+#include <kernel/usercopy.h>
+#include <kernel/cpu.h>
+#include <kernel/pagings.h>
+#include <kernel/process.h>
+#include <string.h>
+
+typedef struct {
+	uint32_t insn;
+	uint32_t fixup;
+} usercopy_ex_entry_t;
+
+extern const usercopy_ex_entry_t __ex_table_start[];
+extern const usercopy_ex_entry_t __ex_table_end[];
+
+extern uint32_t user_copy_raw(void *dst, const void *src, uint32_t len);
+extern int32_t user_strncpy_raw(char *dst, const char *src, uint32_t size);
+
+static bool usercopy_range_ok(uint32_t addr, uint32_t len) {
+	if (addr < USER_SPACE_START) {
+		return false;
+	}
+	uint32_t end = addr + len;
+	return end >= addr && end <= USER_SPACE_END;
+}
+
+// User addresses can only be dereferenced while the process's own directory
+// is loaded. With KPTI the kernel runs on its own directory, so the copy
+// walks the process's page tables instead, once per page.
+static bool usercopy_direct(const process_t *proc) {
+	return read_cr3() == virt_to_phys(proc->page_directory);
+}
+
+bool usercopy_fixup(uint32_t eip, uint32_t *fixup_eip) {
+	for (const usercopy_ex_entry_t *entry = __ex_table_start; entry < __ex_table_end; entry++) {
+		if (entry->insn == eip) {
+			if (fixup_eip) {
+				*fixup_eip = entry->fixup;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+bool copy_from_user(void *dst, uint32_t src, uint32_t len) {
+	if (len == 0) {
+		return true;
+	}
+	process_t *proc = process_current();
+	if (!dst || !proc || !proc->page_directory || !usercopy_range_ok(src, len)) {
+		return false;
+	}
+	if (usercopy_direct(proc)) {
+		return user_copy_raw(dst, (const void *)src, len) == 0;
+	}
+	return page_copy_from_user(proc->page_directory, dst, src, len);
+}
+
+bool copy_to_user(uint32_t dst, const void *src, uint32_t len) {
+	if (len == 0) {
+		return true;
+	}
+	process_t *proc = process_current();
+	if (!src || !proc || !proc->page_directory || !usercopy_range_ok(dst, len)) {
+		return false;
+	}
+	if (usercopy_direct(proc)) {
+		return user_copy_raw((void *)dst, src, len) == 0;
+	}
+	return page_copy_to_user(proc->page_directory, dst, src, len);
+}
+
+bool strncpy_from_user(char *dst, uint32_t src, size_t size) {
+	if (!dst || size == 0) {
+		return false;
+	}
+	dst[0] = '\0';
+	process_t *proc = process_current();
+	if (!proc || !proc->page_directory || src < USER_SPACE_START || src >= USER_SPACE_END) {
+		return false;
+	}
+
+	// Never read past the end of user space, even if size would allow it.
+	uint32_t limit = (uint32_t)size;
+	if (limit > USER_SPACE_END - src) {
+		limit = USER_SPACE_END - src;
+	}
+
+	if (usercopy_direct(proc)) {
+		int32_t len = user_strncpy_raw(dst, (const char *)src, limit);
+		if (len < 0 || (uint32_t)len >= limit) {
+			dst[0] = '\0';
+			return false;
+		}
+		return true;
+	}
+
+	uint32_t copied = 0;
+	while (copied < limit) {
+		uint32_t addr = src + copied;
+		uint32_t phys = 0;
+		if (!page_translate(proc->page_directory, addr, &phys)) {
+			dst[0] = '\0';
+			return false;
+		}
+		uint32_t chunk = PAGE_SIZE - (addr & (PAGE_SIZE - 1));
+		if (chunk > limit - copied) {
+			chunk = limit - copied;
+		}
+		const char *page = (const char *)phys_to_virt(phys);
+		for (uint32_t i = 0; i < chunk; i++) {
+			dst[copied + i] = page[i];
+			if (page[i] == '\0') {
+				return true;
+			}
+		}
+		copied += chunk;
+	}
+
+	dst[0] = '\0';
+	return false;
+}
@@ -57,8 +57,7 @@ static bool usermode_run_scheduler(void) {
 	iret_frame->eflags = next->frame.eflags | 0x200;
 	iret_frame->useresp = next->frame.useresp;
 	iret_frame->userss = GDT_USER_DATA;
-	trampoline_enter_user_mode(virt_to_phys(next->page_directory),
-	                           (uint32_t)iret_frame);
+	trampoline_enter_user_mode(next->user_cr3, (uint32_t)iret_frame);
 
 	process_set_current(NULL);
 	process_scheduler_stop();
@@ -0,0 +1,206 @@
+#include <kernel/wait.h>
+#include <kernel/task.h>
+#include <kernel/timer.h>
+
+void wait_queue_init(wait_queue_t *queue) {
+	if (!queue) {
+		return;
+	}
+	queue->head = NULL;
+	queue->tail = NULL;
+}
+
+void wait_entry_init(wait_entry_t *entry, wait_fn_t fn, void *data) {
+	if (!entry) {
+		return;
+	}
+	entry->next = NULL;
+	entry->prev = NULL;
+	entry->queue = NULL;
+	entry->fn = fn;
+	entry->data = data;
+}
+
+static void wait_link_tail(wait_queue_t *queue, wait_entry_t *entry) {
+	entry->queue = queue;
+	entry->next = NULL;
+	entry->prev = queue->tail;
+	if (queue->tail) {
+		queue->tail->next = entry;
+	} else {
+		queue->head = entry;
+	}
+	queue->tail = entry;
+}
+
+static void wait_unlink(wait_entry_t *entry) {
+	wait_queue_t *queue = entry->queue;
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		queue->head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		queue->tail = entry->prev;
+	}
+	entry->next = NULL;
+	entry->prev = NULL;
+	entry->queue = NULL;
+}
+
+void wait_queue_add(wait_queue_t *queue, wait_entry_t *entry) {
+	if (!queue || !entry || !entry->fn) {
+		return;
+	}
+	uint32_t flags = wait_irq_save();
+	if (entry->queue) {
+		wait_unlink(entry);
+	}
+	wait_link_tail(queue, entry);
+	wait_irq_restore(flags);
+}
+
+void wait_queue_remove(wait_entry_t *entry) {
+	if (!entry) {
+		return;
+	}
+	uint32_t flags = wait_irq_save();
+	if (entry->queue) {
+		wait_unlink(entry);
+	}
+	wait_irq_restore(flags);
+}
+
+bool wait_queue_empty(const wait_queue_t *queue) {
+	return !queue || !queue->head;
+}
+
+uint32_t wake_up(wait_queue_t *queue, uint32_t max, void *key) {
+	if (!queue) {
+		return 0;
+	}
+	// Entries are taken off the head one at a time and the callback runs
+	// with the entry detached, so callbacks may wake, add to or remove from
+	// this queue. Entries that stay asleep go back to the front in order.
+	wait_queue_t kept = {NULL, NULL};
+	uint32_t woken = 0;
+	uint32_t flags = wait_irq_save();
+	while (woken < max && queue->head) {
+		wait_entry_t *entry = queue->head;
+		wait_unlink(entry);
+		wait_irq_restore(flags);
+		bool done = entry->fn(entry, key);
+		flags = wait_irq_save();
+		if (done) {
+			woken++;
+		} else if (!entry->queue) {
+			wait_link_tail(&kept, entry);
+		}
+	}
+	if (kept.head) {
+		for (wait_entry_t *entry = kept.head; entry; entry = entry->next) {
+			entry->queue = queue;
+		}
+		kept.tail->next = queue->head;
+		if (queue->head) {
+			queue->head->prev = kept.tail;
+		} else {
+			queue->tail = kept.tail;
+		}
+		queue->head = kept.head;
+	}
+	wait_irq_restore(flags);
+	return woken;
+}
+
+static bool wait_wake_task(wait_entry_t *entry, void *key) {
+	(void)key;
+	task_unblock((task_t *)entry->data);
+	return true;
+}
+
+void wait_sleep(wait_queue_t *queue) {
+	task_t *task = task_current();
+	if (!task || !task_ready_any()) {
+		// Nothing to switch to: let the interrupt that changes things arrive.
+		cpu_sti();
+		timer_idle();
+		cpu_cli();
+		return;
+	}
+	wait_entry_t entry;
+	wait_entry_init(&entry, wait_wake_task, task);
+	wait_link_tail(queue, &entry);
+	task_block();
+	if (entry.queue) {
+		wait_unlink(&entry);
+	}
+}
+
+void mutex_init(mutex_t *mutex) {
+	if (!mutex) {
+		return;
+	}
+	mutex->locked = false;
+	wait_queue_init(&mutex->waiters);
+}
+
+void mutex_lock(mutex_t *mutex) {
+	uint32_t flags = wait_irq_save();
+	while (mutex->locked) {
+		wait_sleep(&mutex->waiters);
+	}
+	mutex->locked = true;
+	wait_irq_restore(flags);
+}
+
+bool mutex_trylock(mutex_t *mutex) {
+	uint32_t flags = wait_irq_save();
+	bool taken = !mutex->locked;
+	mutex->locked = true;
+	wait_irq_restore(flags);
+	return taken;
+}
+
+void mutex_unlock(mutex_t *mutex) {
+	uint32_t flags = wait_irq_save();
+	mutex->locked = false;
+	wait_irq_restore(flags);
+	wake_up_one(&mutex->waiters);
+}
+
+void semaphore_init(semaphore_t *sem, uint32_t count) {
+	if (!sem) {
+		return;
+	}
+	sem->count = count;
+	wait_queue_init(&sem->waiters);
+}
+
+void semaphore_down(semaphore_t *sem) {
+	uint32_t flags = wait_irq_save();
+	while (sem->count == 0) {
+		wait_sleep(&sem->waiters);
+	}
+	sem->count--;
+	wait_irq_restore(flags);
+}
+
+bool semaphore_trydown(semaphore_t *sem) {
+	uint32_t flags = wait_irq_save();
+	bool taken = sem->count > 0;
+	if (taken) {
+		sem->count--;
+	}
+	wait_irq_restore(flags);
+	return taken;
+}
+
+void semaphore_up(semaphore_t *sem) {
+	uint32_t flags = wait_irq_save();
+	sem->count++;
+	wait_irq_restore(flags);
+	wake_up_one(&sem->waiters);
+}
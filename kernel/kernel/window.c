@@ -1,6 +1,7 @@
 #include <kernel/window.h>
 #include <kernel/graphics.h>
 #include <kernel/kmalloc.h>
+#include <kernel/slab.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -13,7 +14,17 @@ extern const uint8_t font_8x8[256][8];
 // Global window manager
 static window_manager_t wm = {0};
 
+// Object caches for window and context menu structures
+static kmem_cache_t* window_cache = NULL;
+static kmem_cache_t* context_menu_cache = NULL;
+static kmem_cache_t* context_menu_item_cache = NULL;
+
 void window_manager_init(void) {
+    if (!window_cache) {
+        window_cache = kmem_cache_create("window", sizeof(window_t), 0, NULL);
+        context_menu_cache = kmem_cache_create("context_menu", sizeof(context_menu_t), 0, NULL);
+        context_menu_item_cache = kmem_cache_create("context_menu_item", sizeof(context_menu_item_t), 0, NULL);
+    }
     wm.window_list = NULL;
     wm.focused_window = NULL;
     wm.cursor_x = graphics_get_width() / 2;
@@ -44,7 +55,7 @@ window_t* window_create(int x, int y, int width, int height, const char* title)
     if (y + height > screen_height) y = screen_height - height;
     
     // Allocate window structure
-    window_t* window = (window_t*)kmalloc(sizeof(window_t));
+    window_t* window = (window_t*)kmem_cache_alloc(window_cache);
     if (!window) return NULL;
     
     // Calculate content area size
@@ -54,7 +65,7 @@ window_t* window_create(int x, int y, int width, int height, const char* title)
     // Allocate framebuffer for content area
     window->framebuffer = (uint8_t*)kmalloc(content_width * content_height);
     if (!window->framebuffer) {
-        kfree(window);
+        kmem_cache_free(window_cache, window);
         return NULL;
     }
     
@@ -140,7 +151,7 @@ void window_destroy(window_t* window) {
     if (window->user_data) {
         kfree(window->user_data);
     }
-    kfree(window);
+    kmem_cache_free(window_cache, window);
 }
 
 void window_move(window_t* window, int x, int y) {
@@ -651,7 +662,7 @@ void window_draw_cursor(void) {
 
 // Create a new context menu
 context_menu_t* context_menu_create(window_t* owner) {
-    context_menu_t* menu = (context_menu_t*)kmalloc(sizeof(context_menu_t));
+    context_menu_t* menu = (context_menu_t*)kmem_cache_alloc(context_menu_cache);
     if (!menu) return NULL;
     
     menu->x = 0;
@@ -675,18 +686,18 @@ void context_menu_destroy(context_menu_t* menu) {
     context_menu_item_t* item = menu->items;
     while (item) {
         context_menu_item_t* next = item->next;
-        kfree(item);
+        kmem_cache_free(context_menu_item_cache, item);
         item = next;
     }
     
-    kfree(menu);
+    kmem_cache_free(context_menu_cache, menu);
 }
 
 // Add a menu item
 void context_menu_add_item(context_menu_t* menu, const char* label, void (*on_select)(window_t*)) {
     if (!menu) return;
     
-    context_menu_item_t* item = (context_menu_item_t*)kmalloc(sizeof(context_menu_item_t));
+    context_menu_item_t* item = (context_menu_item_t*)kmem_cache_alloc(context_menu_item_cache);
     if (!item) return;
     
     strncpy(item->label, label, sizeof(item->label) - 1);
@@ -719,7 +730,7 @@ void context_menu_add_item(context_menu_t* menu, const char* label, void (*on_se
 void context_menu_add_separator(context_menu_t* menu) {
     if (!menu) return;
     
-    context_menu_item_t* item = (context_menu_item_t*)kmalloc(sizeof(context_menu_item_t));
+    context_menu_item_t* item = (context_menu_item_t*)kmem_cache_alloc(context_menu_item_cache);
     if (!item) return;
     
     item->label[0] = '\0';
@@ -39,10 +39,22 @@ void graphics_draw_char(int x, int y, char c, uint8_t fg, uint8_t bg);
 void graphics_print(int x, int y, const char* str, uint8_t fg, uint8_t bg);
 void graphics_blit(int x, int y, int width, int height, const uint8_t* buffer, int stride);
 
+// Clipping applies to batched (double-buffered) drawing only.
+void graphics_set_clip(int x, int y, int width, int height);
+void graphics_reset_clip(void);
+// Submit drawing queued while double buffering (flip does this implicitly).
+void graphics_flush(void);
+
 void graphics_enable_double_buffer(void);
 void graphics_disable_double_buffer(void);
 void graphics_flip_buffer(void);
 
+// Map a width * height pixel surface into this process (NULL in text mode).
+// Draw into it with plain stores, then graphics_present() copies the whole
+// frame to the screen. Call again after a mode change to grow the surface.
+uint8_t *graphics_map_surface(void);
+bool graphics_present(void);
+
 int graphics_get_width(void);
 int graphics_get_height(void);
 
@@ -0,0 +1,38 @@
+#ifndef _USER_INPUT_H
+#define _USER_INPUT_H
+
+#include <stdint.h>
+
+// Events read from /dev/input, in the kernel's input_event_t layout. While
+// a process holds /dev/input open, keyboard and mouse input goes there
+// instead of getchar() and mouse_get_state(). read() returns whole events
+// and never blocks; poll() for POLLIN to wait.
+
+#define INPUT_EV_SYN  0x00
+#define INPUT_EV_KEY  0x01
+#define INPUT_EV_REL  0x02
+#define INPUT_EV_CHAR 0x10          // value: the key as getchar() returns it
+
+#define INPUT_SYN_REPORT  0         // End of one key press or mouse packet
+#define INPUT_SYN_DROPPED 3         // Queue overflowed; earlier events lost
+
+#define INPUT_REL_X     0x00        // Positive to the right
+#define INPUT_REL_Y     0x01        // Positive downwards
+#define INPUT_REL_WHEEL 0x08        // Positive away from the user
+
+#define INPUT_BTN_LEFT   0x110
+#define INPUT_BTN_RIGHT  0x111
+#define INPUT_BTN_MIDDLE 0x112
+
+#define INPUT_KEY_RELEASE 0
+#define INPUT_KEY_PRESS   1
+#define INPUT_KEY_REPEAT  2
+
+typedef struct {
+	uint64_t time_ns;               // Nanoseconds since boot
+	uint16_t type;
+	uint16_t code;
+	int32_t value;
+} input_event_t;
+
+#endif
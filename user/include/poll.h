@@ -0,0 +1,25 @@
+#ifndef _USER_POLL_H
+#define _USER_POLL_H
+
+#include <stdint.h>
+
+#define POLLIN   0x0001
+#define POLLOUT  0x0004
+#define POLLERR  0x0008
+#define POLLHUP  0x0010
+#define POLLNVAL 0x0020
+
+struct pollfd {
+	int fd;             // Negative entries are skipped
+	short events;
+	short revents;
+};
+
+// Wait until one of `nfds` (at most 16) descriptors is ready. `timeout` is
+// in milliseconds; -1 waits forever and 0 only checks. Returns the number
+// of ready descriptors, 0 on timeout or -1 on error. Besides pipes and the
+// terminal this works on open("/dev/mouse") and open("/dev/keyboard"),
+// which become readable when there is new input.
+int poll(struct pollfd *fds, uint32_t nfds, int timeout);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _USER_SYS_MMAN_H
+#define _USER_SYS_MMAN_H
+
+#include <stdint.h>
+
+// Shared memory objects. shm_open returns a descriptor; every process that
+// maps it sees the same pages. Named objects can be opened by name from
+// any process until shm_unlink; anonymous ones (name NULL) are shared by
+// forking with the descriptor open. Objects hold at most 4 MiB.
+
+#define SHM_CREATE 0x1
+#define SHM_EXCL   0x2
+
+#define SHM_MAP_WRITE 0x1
+
+int shm_open(const char *name, uint32_t size, int flags);
+int shm_unlink(const char *name);
+// Map the whole object; returns NULL on failure.
+void *shm_map(int fd, int flags);
+int shm_unmap(void *addr, uint32_t size);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _USER_THREAD_H
+#define _USER_THREAD_H
+
+#include <stdint.h>
+
+// Threads share the address space, descriptors and working directory of
+// the process that creates them. exit() from any thread ends them all;
+// thread_exit() ends only the caller (in the main thread it exits).
+
+typedef struct {
+	int tid;
+	volatile uint32_t running;  // Cleared by the kernel when the thread ends
+	void *stack;
+} thread_t;
+
+// Run fn(arg) on a new thread with a `stack_size` byte stack from the heap
+// (0 for the default). Returns the thread id, or -1.
+int thread_create(thread_t *thread, void (*fn)(void *), void *arg, uint32_t stack_size);
+// Wait for the thread to end and free its stack.
+int thread_join(thread_t *thread);
+void thread_exit(int code);
+
+// Sleep while *addr == expected, until futex_wake on the same word or for
+// `timeout_ms` (-1 waits forever). Returns 0 once woken or timed out, -1
+// at once if the word no longer holds `expected`. Words in shared memory
+// work across processes.
+int futex_wait(volatile uint32_t *addr, uint32_t expected, int timeout_ms);
+// Wake up to `count` waiters on addr. Returns how many woke.
+int futex_wake(volatile uint32_t *addr, uint32_t count);
+
+// Mutex that only enters the kernel when contended. Zero-initialize it or
+// use THREAD_MUTEX_INIT.
+typedef struct {
+	volatile uint32_t state;    // 0 unlocked, 1 locked, 2 locked with waiters
+} thread_mutex_t;
+
+#define THREAD_MUTEX_INIT {0}
+
+void thread_mutex_lock(thread_mutex_t *mutex);
+int thread_mutex_trylock(thread_mutex_t *mutex);
+void thread_mutex_unlock(thread_mutex_t *mutex);
+
+#endif
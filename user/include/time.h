@@ -0,0 +1,18 @@
+#ifndef _USER_TIME_H
+#define _USER_TIME_H
+
+#include <stdint.h>
+
+#define CLOCK_MONOTONIC 1
+
+struct timespec {
+	uint32_t tv_sec;
+	uint32_t tv_nsec;
+};
+
+// Time since boot. Reads the kernel's clock page directly when the TSC is
+// usable, so it normally costs no syscall.
+int clock_gettime(int clock_id, struct timespec *ts);
+uint64_t clock_gettime_ns(void);
+
+#endif
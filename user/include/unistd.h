@@ -19,7 +19,8 @@ typedef struct {
 	uint32_t pid;
 	uint8_t state;
 	uint8_t priority;
-	uint16_t reserved;
+	int8_t nice;
+	uint8_t reserved;
 	uint32_t time_slice;
 	uint32_t total_time;
 	char name[32];
@@ -85,7 +86,15 @@ int keyboard_set_repeat(uint8_t delay, uint8_t rate);
 void *sbrk(intptr_t increment);
 int brk(void *addr);
 int pipe(int fds[2]);
+// Set how far a pipe's buffer may grow (up to 64 KiB; 0 queries). Returns
+// the capacity in bytes or -1.
+int pipe_size(int fd, int size);
 int dup2(int oldfd, int newfd);
 int kill(int pid, int sig);
+// Nice values run from -20 (favoured) to 19; lower values let a process
+// stay on higher scheduling levels. nice() adjusts the caller and returns
+// the new value; renice() adjusts any pid and returns 0 or -1.
+int nice(int increment);
+int renice(int pid, int increment, int *out_nice);
 
 #endif
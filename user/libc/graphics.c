@@ -1,5 +1,6 @@
 #include <graphics.h>
 #include <stdint.h>
+#include <string.h>
 #include "syscall.h"
 
 typedef struct {
@@ -49,7 +50,141 @@ typedef struct {
 	const uint8_t *pixels;
 } gfx_blit_t;
 
+// Command buffer for SYSCALL_GFX_SUBMIT; layouts match the kernel's.
+#define GFX_BATCH_SIZE 4096
+
+enum {
+	GFX_CMD_CLEAR = 1,
+	GFX_CMD_PIXEL,
+	GFX_CMD_RECT,
+	GFX_CMD_FILL_RECT,
+	GFX_CMD_LINE,
+	GFX_CMD_CHAR,
+	GFX_CMD_TEXT,
+	GFX_CMD_BLIT,
+	GFX_CMD_CLIP,
+	GFX_CMD_CLIP_RESET,
+};
+
+typedef struct {
+	uint16_t op;
+	uint16_t size;
+} gfx_cmd_header_t;
+
+typedef struct {
+	gfx_cmd_header_t hdr;
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+	uint8_t color;
+	uint8_t reserved[3];
+} gfx_cmd_rect_t;
+
+typedef struct {
+	gfx_cmd_header_t hdr;
+	int32_t x1;
+	int32_t y1;
+	int32_t x2;
+	int32_t y2;
+	uint8_t color;
+	uint8_t reserved[3];
+} gfx_cmd_line_t;
+
+typedef struct {
+	gfx_cmd_header_t hdr;
+	int32_t x;
+	int32_t y;
+	uint8_t fg;
+	uint8_t bg;
+	uint16_t len;
+} gfx_cmd_text_t;
+
+typedef struct {
+	gfx_cmd_header_t hdr;
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+	int32_t stride;
+	uint32_t pixels;
+} gfx_cmd_blit_t;
+
+// Drawing is only batched while double buffering is on: nothing reaches the
+// screen before the next flip anyway, so one syscall per frame suffices.
+static uint8_t gfx_batch[GFX_BATCH_SIZE] __attribute__((aligned(4)));
+static uint32_t gfx_batch_len = 0;
+static bool gfx_batching = false;
+// The kernel resets the clip after each submit, so an active clip is
+// replayed at the start of every batch.
+static bool gfx_clip_active = false;
+static int32_t gfx_clip[4];
+
+void graphics_flush(void) {
+	if (gfx_batch_len == 0) {
+		return;
+	}
+	syscall3(SYSCALL_GFX_SUBMIT, (uint32_t)gfx_batch, gfx_batch_len, 0);
+	gfx_batch_len = 0;
+}
+
+// Reserve room for a command, flushing first if the buffer is full. Returns
+// NULL when not batching (or the command can never fit); the caller then
+// falls back to the single-shot syscall.
+static void *gfx_batch_reserve(uint16_t op, uint32_t size) {
+	size = (size + 3) & ~3u;
+	if (!gfx_batching || size > GFX_BATCH_SIZE - sizeof(gfx_cmd_rect_t)) {
+		return NULL;
+	}
+	if (gfx_batch_len + size > GFX_BATCH_SIZE - sizeof(gfx_cmd_rect_t)) {
+		graphics_flush();
+	}
+	if (gfx_batch_len == 0 && gfx_clip_active && op != GFX_CMD_CLIP) {
+		gfx_cmd_rect_t *clip = (gfx_cmd_rect_t *)gfx_batch;
+		memset(clip, 0, sizeof(*clip));
+		clip->hdr.op = GFX_CMD_CLIP;
+		clip->hdr.size = sizeof(*clip);
+		memcpy(&clip->x, gfx_clip, sizeof(gfx_clip));
+		gfx_batch_len = sizeof(*clip);
+	}
+	gfx_cmd_header_t *hdr = (gfx_cmd_header_t *)(gfx_batch + gfx_batch_len);
+	memset(hdr, 0, size);
+	hdr->op = op;
+	hdr->size = (uint16_t)size;
+	gfx_batch_len += size;
+	return hdr;
+}
+
+static bool gfx_batch_rect(uint16_t op, int x, int y, int width, int height, uint8_t color) {
+	gfx_cmd_rect_t *cmd = gfx_batch_reserve(op, sizeof(*cmd));
+	if (!cmd) {
+		return false;
+	}
+	cmd->x = x;
+	cmd->y = y;
+	cmd->width = width;
+	cmd->height = height;
+	cmd->color = color;
+	return true;
+}
+
+static bool gfx_batch_text(uint16_t op, int x, int y, const char *text, uint32_t len,
+                           uint8_t fg, uint8_t bg) {
+	gfx_cmd_text_t *cmd = gfx_batch_reserve(op, sizeof(*cmd) + len);
+	if (!cmd) {
+		return false;
+	}
+	cmd->x = x;
+	cmd->y = y;
+	cmd->fg = fg;
+	cmd->bg = bg;
+	cmd->len = (uint16_t)len;
+	memcpy(cmd + 1, text, len);
+	return true;
+}
+
 bool graphics_set_mode(uint8_t mode) {
+	graphics_flush();
 	return syscall3(SYSCALL_GFX_SET_MODE, mode, 0, 0) == 0;
 }
 
@@ -62,56 +197,134 @@ void graphics_return_to_text(void) {
 }
 
 void graphics_putpixel(int x, int y, uint8_t color) {
+	if (gfx_batch_rect(GFX_CMD_PIXEL, x, y, 0, 0, color)) {
+		return;
+	}
 	gfx_pixel_t args = {x, y, color};
 	syscall3(SYSCALL_GFX_PUTPIXEL, (uint32_t)&args, 0, 0);
 }
 
 void graphics_clear(uint8_t color) {
+	if (gfx_batching) {
+		// Everything queued so far is about to be overwritten.
+		gfx_batch_len = 0;
+		if (gfx_batch_rect(GFX_CMD_CLEAR, 0, 0, 0, 0, color)) {
+			return;
+		}
+	}
 	syscall3(SYSCALL_GFX_CLEAR, color, 0, 0);
 }
 
 void graphics_draw_line(int x1, int y1, int x2, int y2, uint8_t color) {
+	gfx_cmd_line_t *cmd = gfx_batch_reserve(GFX_CMD_LINE, sizeof(*cmd));
+	if (cmd) {
+		cmd->x1 = x1;
+		cmd->y1 = y1;
+		cmd->x2 = x2;
+		cmd->y2 = y2;
+		cmd->color = color;
+		return;
+	}
 	gfx_line_t args = {x1, y1, x2, y2, color};
 	syscall3(SYSCALL_GFX_DRAW_LINE, (uint32_t)&args, 0, 0);
 }
 
 void graphics_draw_rect(int x, int y, int width, int height, uint8_t color) {
+	if (gfx_batch_rect(GFX_CMD_RECT, x, y, width, height, color)) {
+		return;
+	}
 	gfx_rect_t args = {x, y, width, height, color};
 	syscall3(SYSCALL_GFX_DRAW_RECT, (uint32_t)&args, 0, 0);
 }
 
 void graphics_fill_rect(int x, int y, int width, int height, uint8_t color) {
+	if (gfx_batch_rect(GFX_CMD_FILL_RECT, x, y, width, height, color)) {
+		return;
+	}
 	gfx_rect_t args = {x, y, width, height, color};
 	syscall3(SYSCALL_GFX_FILL_RECT, (uint32_t)&args, 0, 0);
 }
 
 void graphics_draw_char(int x, int y, char c, uint8_t fg, uint8_t bg) {
+	if (gfx_batch_text(GFX_CMD_CHAR, x, y, &c, 1, fg, bg)) {
+		return;
+	}
 	gfx_char_t args = {x, y, c, fg, bg};
 	syscall3(SYSCALL_GFX_DRAW_CHAR, (uint32_t)&args, 0, 0);
 }
 
 void graphics_print(int x, int y, const char* str, uint8_t fg, uint8_t bg) {
+	// The single-shot syscall truncates text at 127 bytes; keep that limit.
+	uint32_t len = 0;
+	while (len < 127 && str[len]) {
+		len++;
+	}
+	if (gfx_batch_text(GFX_CMD_TEXT, x, y, str, len, fg, bg)) {
+		return;
+	}
 	gfx_print_t args = {x, y, fg, bg, str};
 	syscall3(SYSCALL_GFX_PRINT, (uint32_t)&args, 0, 0);
 }
 
 void graphics_blit(int x, int y, int width, int height, const uint8_t* buffer, int stride) {
+	gfx_cmd_blit_t *cmd = gfx_batch_reserve(GFX_CMD_BLIT, sizeof(*cmd));
+	if (cmd) {
+		cmd->x = x;
+		cmd->y = y;
+		cmd->width = width;
+		cmd->height = height;
+		cmd->stride = stride;
+		cmd->pixels = (uint32_t)buffer;
+		// The kernel reads the pixels at submit time and the caller may
+		// reuse the buffer as soon as we return.
+		graphics_flush();
+		return;
+	}
 	gfx_blit_t args = {x, y, width, height, stride, buffer};
 	syscall3(SYSCALL_GFX_BLIT, (uint32_t)&args, 0, 0);
 }
 
+void graphics_set_clip(int x, int y, int width, int height) {
+	gfx_clip[0] = x;
+	gfx_clip[1] = y;
+	gfx_clip[2] = width;
+	gfx_clip[3] = height;
+	gfx_clip_active = gfx_batch_rect(GFX_CMD_CLIP, x, y, width, height, 0);
+}
+
+void graphics_reset_clip(void) {
+	if (gfx_clip_active && gfx_batch_reserve(GFX_CMD_CLIP_RESET, sizeof(gfx_cmd_header_t))) {
+		gfx_clip_active = false;
+	}
+}
+
 void graphics_enable_double_buffer(void) {
 	syscall3(SYSCALL_GFX_DOUBLEBUFFER_ENABLE, 0, 0, 0);
+	gfx_batching = true;
 }
 
 void graphics_disable_double_buffer(void) {
+	graphics_flush();
+	gfx_batching = false;
+	gfx_clip_active = false;
 	syscall3(SYSCALL_GFX_DOUBLEBUFFER_DISABLE, 0, 0, 0);
 }
 
 void graphics_flip_buffer(void) {
+	graphics_flush();
 	syscall3(SYSCALL_GFX_FLIP, 0, 0, 0);
 }
 
+uint8_t *graphics_map_surface(void) {
+	uint32_t addr = syscall3(SYSCALL_GFX_MAP_SURFACE, 0, 0, 0);
+	return addr == (uint32_t)-1 ? NULL : (uint8_t *)addr;
+}
+
+bool graphics_present(void) {
+	graphics_flush();
+	return syscall3(SYSCALL_GFX_PRESENT, 0, 0, 0) == 0;
+}
+
 int graphics_get_width(void) {
 	return (int)syscall3(SYSCALL_GFX_GET_WIDTH, 0, 0, 0);
 }
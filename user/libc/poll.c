@@ -0,0 +1,9 @@
+#include <poll.h>
+#include "syscall.h"
+
+int poll(struct pollfd *fds, uint32_t nfds, int timeout) {
+	if (!fds && nfds > 0) {
+		return -1;
+	}
+	return syscall3(SYSCALL_POLL, (uint32_t)fds, nfds, (uint32_t)timeout);
+}
@@ -0,0 +1,26 @@
+#include <sys/mman.h>
+#include <stddef.h>
+#include "syscall.h"
+
+int shm_open(const char *name, uint32_t size, int flags) {
+	return syscall3(SYSCALL_SHM_OPEN, (uint32_t)name, size, (uint32_t)flags);
+}
+
+int shm_unlink(const char *name) {
+	if (!name) {
+		return -1;
+	}
+	return syscall3(SYSCALL_SHM_UNLINK, (uint32_t)name, 0, 0);
+}
+
+void *shm_map(int fd, int flags) {
+	int addr = syscall3(SYSCALL_SHM_MAP, (uint32_t)fd, (uint32_t)flags, 0);
+	if (addr == -1) {
+		return NULL;
+	}
+	return (void *)(uint32_t)addr;
+}
+
+int shm_unmap(void *addr, uint32_t size) {
+	return syscall3(SYSCALL_SHM_UNMAP, (uint32_t)addr, size, 0);
+}
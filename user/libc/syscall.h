@@ -81,8 +81,28 @@
 #define SYSCALL_AUDIO_SET_VOLUME 76
 #define SYSCALL_AUDIO_GET_VOLUME 77
 #define SYSCALL_AUDIO_STATUS 78
+#define SYSCALL_FAST_ENTRY 79
+#define SYSCALL_GFX_SUBMIT 80
+#define SYSCALL_GFX_MAP_SURFACE 81
+#define SYSCALL_GFX_PRESENT 82
+#define SYSCALL_CLOCK_GETTIME 83
+#define SYSCALL_NICE 84
+#define SYSCALL_PIPE_SIZE 85
+#define SYSCALL_POLL 86
+#define SYSCALL_SHM_OPEN 87
+#define SYSCALL_SHM_MAP 88
+#define SYSCALL_SHM_UNMAP 89
+#define SYSCALL_SHM_UNLINK 90
+#define SYSCALL_THREAD_CREATE 91
+#define SYSCALL_THREAD_EXIT 92
+#define SYSCALL_FUTEX_WAIT 93
+#define SYSCALL_FUTEX_WAKE 94
 
-static inline int syscall3(int num, uint32_t a, uint32_t b, uint32_t c) {
+// Nonzero when the kernel accepts SYSENTER; chosen once by crt0.
+extern int __syscall_sysenter;
+void __syscall_init(void);
+
+static inline int syscall3_int80(int num, uint32_t a, uint32_t b, uint32_t c) {
 	int ret;
 	__asm__ volatile ("int $0x80"
 		: "=a"(ret)
@@ -91,4 +111,27 @@ static inline int syscall3(int num, uint32_t a, uint32_t b, uint32_t c) {
 	return ret;
 }
 
+// SYSENTER entry: the kernel returns to the EIP in ESI with the stack in EBP
+// and leaves ECX, EDX and the flags clobbered.
+static inline int syscall3_sysenter(int num, uint32_t a, uint32_t b, uint32_t c) {
+	int ret;
+	__asm__ volatile ("push %%ebp\n\t"
+		"movl %%esp, %%ebp\n\t"
+		"movl $1f, %%esi\n\t"
+		"sysenter\n"
+		"1:\n\t"
+		"pop %%ebp"
+		: "=a"(ret), "+c"(b), "+d"(c)
+		: "a"(num), "b"(a)
+		: "esi", "memory", "cc");
+	return ret;
+}
+
+static inline int syscall3(int num, uint32_t a, uint32_t b, uint32_t c) {
+	if (__syscall_sysenter) {
+		return syscall3_sysenter(num, a, b, c);
+	}
+	return syscall3_int80(num, a, b, c);
+}
+
 #endif
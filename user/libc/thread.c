@@ -0,0 +1,94 @@
+#include <thread.h>
+#include <stdlib.h>
+#include "syscall.h"
+
+#define THREAD_STACK_DEFAULT 16384
+
+// First code on a new thread. thread_create lays out the stack as if fn
+// and arg had been passed by a call, with no return address to go back to.
+static void thread_start(void (*fn)(void *), void *arg) {
+	fn(arg);
+	thread_exit(0);
+}
+
+int thread_create(thread_t *thread, void (*fn)(void *), void *arg, uint32_t stack_size) {
+	if (!thread || !fn) {
+		return -1;
+	}
+	if (stack_size == 0) {
+		stack_size = THREAD_STACK_DEFAULT;
+	}
+	uint8_t *stack = (uint8_t *)malloc(stack_size);
+	if (!stack) {
+		return -1;
+	}
+	// Keep the arguments 16-byte aligned, as after a call from C.
+	uint32_t *sp = (uint32_t *)(((uint32_t)(stack + stack_size) & ~15u) - 8);
+	*--sp = (uint32_t)arg;
+	*--sp = (uint32_t)fn;
+	*--sp = 0;
+	thread->stack = stack;
+	thread->running = 1;
+	thread->tid = syscall3(SYSCALL_THREAD_CREATE, (uint32_t)thread_start, (uint32_t)sp,
+	                       (uint32_t)&thread->running);
+	if (thread->tid < 0) {
+		thread->running = 0;
+		thread->stack = NULL;
+		free(stack);
+		return -1;
+	}
+	return thread->tid;
+}
+
+int thread_join(thread_t *thread) {
+	if (!thread || !thread->stack) {
+		return -1;
+	}
+	uint32_t running;
+	while ((running = thread->running) != 0) {
+		futex_wait(&thread->running, running, -1);
+	}
+	free(thread->stack);
+	thread->stack = NULL;
+	return 0;
+}
+
+void thread_exit(int code) {
+	syscall3(SYSCALL_THREAD_EXIT, (uint32_t)code, 0, 0);
+	for (;;) { }
+}
+
+int futex_wait(volatile uint32_t *addr, uint32_t expected, int timeout_ms) {
+	return syscall3(SYSCALL_FUTEX_WAIT, (uint32_t)addr, expected, (uint32_t)timeout_ms);
+}
+
+int futex_wake(volatile uint32_t *addr, uint32_t count) {
+	return syscall3(SYSCALL_FUTEX_WAKE, (uint32_t)addr, count, 0);
+}
+
+// The three-state mutex: unlock only enters the kernel when a locker may
+// be sleeping (state 2).
+void thread_mutex_lock(thread_mutex_t *mutex) {
+	uint32_t state = __sync_val_compare_and_swap(&mutex->state, 0, 1);
+	if (state == 0) {
+		return;
+	}
+	if (state != 2) {
+		state = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+	}
+	while (state != 0) {
+		futex_wait(&mutex->state, 2, -1);
+		state = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+int thread_mutex_trylock(thread_mutex_t *mutex) {
+	return __sync_val_compare_and_swap(&mutex->state, 0, 1) == 0 ? 0 : -1;
+}
+
+void thread_mutex_unlock(thread_mutex_t *mutex) {
+	if (__atomic_fetch_sub(&mutex->state, 1, __ATOMIC_RELEASE) != 1) {
+		__atomic_store_n(&mutex->state, 0, __ATOMIC_RELEASE);
+		futex_wake(&mutex->state, 1);
+	}
+}
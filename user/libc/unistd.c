@@ -2,6 +2,12 @@
 #include <stdint.h>
 #include "syscall.h"
 
+int __syscall_sysenter = 0;
+
+void __syscall_init(void) {
+	__syscall_sysenter = syscall3_int80(SYSCALL_FAST_ENTRY, 0, 0, 0) == 1;
+}
+
 int write(const void *buf, uint32_t len) {
 	return syscall3(SYSCALL_WRITE, (uint32_t)buf, len, 0);
 }
@@ -301,6 +307,13 @@ int pipe(int fds[2]) {
 	return syscall3(SYSCALL_PIPE, (uint32_t)fds, 0, 0);
 }
 
+int pipe_size(int fd, int size) {
+	if (size < 0) {
+		return -1;
+	}
+	return syscall3(SYSCALL_PIPE_SIZE, (uint32_t)fd, (uint32_t)size, 0);
+}
+
 int dup2(int oldfd, int newfd) {
 	return syscall3(SYSCALL_DUP2, (uint32_t)oldfd, (uint32_t)newfd, 0);
 }
@@ -308,3 +321,21 @@ int dup2(int oldfd, int newfd) {
 int kill(int pid, int sig) {
 	return syscall3(SYSCALL_KILL, (uint32_t)pid, (uint32_t)sig, 0);
 }
+
+// The kernel returns the nice value plus 20, keeping -1 for errors.
+int renice(int pid, int increment, int *out_nice) {
+	int ret = syscall3(SYSCALL_NICE, (uint32_t)pid, (uint32_t)increment, 0);
+	if (ret < 0) {
+		return -1;
+	}
+	if (out_nice) {
+		*out_nice = ret - 20;
+	}
+	return 0;
+}
+
+int nice(int increment) {
+	int value = 0;
+	renice(0, increment, &value);
+	return value;
+}
@@ -1,6 +1,8 @@
 #include <uwm.h>
 #include <graphics.h>
+#include <input.h>
 #include <mouse.h>
+#include <poll.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -81,6 +83,14 @@ static uint32_t last_title_click_ticks = 0;
 static uint32_t switcher_until = 0;
 static char uwm_clipboard[256];
 static bool uwm_force_redraw = false;
+static bool alt_pressed = false;
+static bool ctrl_pressed = false;
+// Events read from /dev/input but not handled yet, and the buttons they
+// left held down.
+static input_event_t input_events[64];
+static uint32_t input_event_count = 0;
+static uint32_t input_event_pos = 0;
+static uint8_t input_buttons = 0;
 
 static void focus_window(uwm_window_t* win);
 static void recompute_client(uwm_window_t* win);
@@ -659,19 +669,169 @@ void uwm_request_redraw(void) {
 	uwm_force_redraw = true;
 }
 
+// Handle one key as getchar() returns it. Returns true if the screen needs
+// a redraw.
+static bool handle_key(int key) {
+	if (key == 27) {
+		if (cancel_active_interactions()) {
+			return true;
+		}
+		uwm_running = false;
+		return false;
+	}
+
+	if (key == UWM_KEY_ALT_DOWN) {
+		alt_pressed = true;
+		return false;
+	}
+	if (key == UWM_KEY_ALT_UP) {
+		alt_pressed = false;
+		return false;
+	}
+	if (key == UWM_KEY_CTRL_DOWN) {
+		ctrl_pressed = true;
+		return false;
+	}
+	if (key == UWM_KEY_CTRL_UP) {
+		ctrl_pressed = false;
+		return false;
+	}
+
+	if (ctrl_pressed) {
+		if (key >= 'a' && key <= 'z') {
+			key = key - 'a' + 1;
+		} else if (key >= 'A' && key <= 'Z') {
+			key = key - 'A' + 1;
+		}
+	}
+
+	if (alt_pressed && key == '\t') {
+		focus_prev_window();
+		if (window_count > 0) {
+			switcher_until = get_ticks() + UWM_SWITCHER_TICKS;
+		}
+		return true;
+	}
+
+	if (alt_pressed && key == UWM_KEY_F4) {
+		for (int i = window_count - 1; i >= 0; i--) {
+			if (window_order[i]->focused) {
+				uwm_window_destroy(window_order[i]);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	for (int i = window_count - 1; i >= 0; i--) {
+		if (window_order[i]->focused && window_order[i]->on_key) {
+			window_order[i]->on_key(window_order[i], key);
+			break;
+		}
+	}
+	if (background_key && (!window_count || !window_order[window_count - 1]->focused)) {
+		background_key(NULL, key);
+	}
+	return true;
+}
+
+static int clamp_delta(int value) {
+	if (value > 127) {
+		return 127;
+	}
+	if (value < -128) {
+		return -128;
+	}
+	return value;
+}
+
+// Fold queued /dev/input events into one mouse state, passing typed keys
+// to handle_key on the way. Stops before a second button change or motion
+// that would overflow the state, leaving the rest for the next frame, so a
+// quick click still shows up as a press and then a release. Motion that
+// overflows an axis on its own is clamped rather than left queued. Returns
+// true if a key asked for a redraw.
+static bool collect_input(int fd, mouse_state_t *state) {
+	bool redraw = false;
+	bool buttons_changed = false;
+	int dx = 0;
+	int dy = 0;
+	int wheel = 0;
+	while (uwm_running) {
+		if (input_event_pos == input_event_count) {
+			int got = read(fd, input_events, sizeof(input_events));
+			if (got <= 0) {
+				break;
+			}
+			input_event_count = (uint32_t)got / sizeof(input_event_t);
+			input_event_pos = 0;
+		}
+		const input_event_t *event = &input_events[input_event_pos];
+		if (event->type == INPUT_EV_REL) {
+			int *axis = event->code == INPUT_REL_X ? &dx :
+			            event->code == INPUT_REL_Y ? &dy :
+			            event->code == INPUT_REL_WHEEL ? &wheel : NULL;
+			if (axis) {
+				// Y and the wheel are negated into the state.
+				int sum = *axis + event->value;
+				int shown = axis == &dx ? sum : -sum;
+				if (*axis != 0 && clamp_delta(shown) != shown) {
+					break;
+				}
+				*axis = sum;
+			}
+		} else if (event->type == INPUT_EV_KEY && event->code >= INPUT_BTN_LEFT &&
+		           event->code <= INPUT_BTN_MIDDLE) {
+			if (buttons_changed) {
+				break;
+			}
+			uint8_t mask = (uint8_t)(1u << (event->code - INPUT_BTN_LEFT));
+			if (event->value) {
+				input_buttons |= mask;
+			} else {
+				input_buttons &= (uint8_t)~mask;
+			}
+			buttons_changed = true;
+		} else if (event->type == INPUT_EV_CHAR) {
+			if (handle_key(event->value)) {
+				redraw = true;
+			}
+		}
+		input_event_pos++;
+	}
+	memset(state, 0, sizeof(*state));
+	state->x = (int8_t)clamp_delta(dx);
+	state->y = (int8_t)clamp_delta(-dy);
+	state->scroll = (int8_t)clamp_delta(-wheel);
+	state->buttons = input_buttons;
+	return redraw;
+}
+
 void uwm_run(void) {
 	int cursor_x = graphics_get_width() / 2;
 	int cursor_y = graphics_get_height() / 2;
 	uint8_t prev_buttons = 0;
 	bool needs_redraw = true;
-	bool alt_pressed = false;
-	bool ctrl_pressed = false;
+	alt_pressed = false;
+	ctrl_pressed = false;
+
+	// Holding /dev/input routes all keyboard and mouse input to it. Each
+	// frame handles what arrived since the last one; in between the loop
+	// sleeps in poll() until there is more.
+	int input_fd = open("/dev/input");
+	input_event_count = 0;
+	input_event_pos = 0;
+	input_buttons = 0;
 
 	uwm_running = true;
 	while (uwm_running) {
 		uint32_t now_ticks = get_ticks();
 		mouse_state_t state;
-		if (mouse_get_state(&state) < 0) {
+		if (input_fd >= 0) {
+			if (collect_input(input_fd, &state)) {
+				needs_redraw = true;
+			}
+		} else if (mouse_get_state(&state) < 0) {
 			continue;
 		}
 
@@ -818,72 +978,12 @@ void uwm_run(void) {
 			needs_redraw = true;
 		}
 
-		if (keyboard_has_input()) {
-			int key = getchar();
-			if (key == 27) {
-				if (cancel_active_interactions()) {
+		if (input_fd < 0) {
+			while (uwm_running && keyboard_has_input()) {
+				if (handle_key(getchar())) {
 					needs_redraw = true;
-					continue;
-				}
-				uwm_running = false;
-				continue;
-			}
-
-			if (key == UWM_KEY_ALT_DOWN) {
-				alt_pressed = true;
-				continue;
-			}
-			if (key == UWM_KEY_ALT_UP) {
-				alt_pressed = false;
-				continue;
-			}
-			if (key == UWM_KEY_CTRL_DOWN) {
-				ctrl_pressed = true;
-				continue;
-			}
-			if (key == UWM_KEY_CTRL_UP) {
-				ctrl_pressed = false;
-				continue;
-			}
-
-			if (ctrl_pressed) {
-				if (key >= 'a' && key <= 'z') {
-					key = key - 'a' + 1;
-				} else if (key >= 'A' && key <= 'Z') {
-					key = key - 'A' + 1;
 				}
 			}
-
-			if (alt_pressed && key == '\t') {
-				focus_prev_window();
-				if (window_count > 0) {
-					switcher_until = get_ticks() + UWM_SWITCHER_TICKS;
-				}
-				needs_redraw = true;
-				continue;
-			}
-
-			if (alt_pressed && key == UWM_KEY_F4) {
-				for (int i = window_count - 1; i >= 0; i--) {
-					if (window_order[i]->focused) {
-						uwm_window_destroy(window_order[i]);
-						needs_redraw = true;
-						break;
-					}
-				}
-				continue;
-			}
-
-			for (int i = window_count - 1; i >= 0; i--) {
-				if (window_order[i]->focused && window_order[i]->on_key) {
-					window_order[i]->on_key(window_order[i], key);
-					break;
-				}
-			}
-			if (background_key && (!window_count || !window_order[window_count - 1]->focused)) {
-				background_key(NULL, key);
-			}
-			needs_redraw = true;
 		}
 
 		if (switcher_until) {
@@ -930,7 +1030,31 @@ void uwm_run(void) {
 		}
 
 		prev_buttons = buttons;
-		sleep_ms(16);
+		if (!uwm_running) {
+			break;
+		}
+		if (input_fd < 0) {
+			sleep_ms(16);
+			continue;
+		}
+		// Ticking windows and the switcher overlay still want a frame
+		// every 16 ms; otherwise wait for input as long as it takes.
+		bool animating = switcher_until != 0 || uwm_force_redraw;
+		for (int i = 0; i < window_count && !animating; i++) {
+			if (window_order[i] && window_order[i]->on_tick) {
+				animating = true;
+			}
+		}
+		int timeout = animating ? 16 : -1;
+		if (input_event_pos < input_event_count) {
+			timeout = 0;
+		}
+		struct pollfd input_poll = { input_fd, POLLIN, 0 };
+		poll(&input_poll, 1, timeout);
+	}
+
+	if (input_fd >= 0) {
+		close(input_fd);
 	}
 
 	graphics_disable_double_buffer();